@@ -0,0 +1,475 @@
+#include "IOPool/Common/bin/ChecksumUtil.h"
+#include "IOPool/Common/bin/ParallelFor.h"
+#include "IOPool/Common/interface/Adler32Kernels.h"
+#include "IOPool/Common/interface/Crc32c.h"
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "TFile.h"
+
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace edm {
+
+  namespace {
+    // Read buffers are page aligned, as O_DIRECT requires.
+    size_t const kBufferAlignment = 4096;
+
+    struct FreeDeleter {
+      void operator()(char* p) const { free(p); }
+    };
+    typedef std::unique_ptr<char, FreeDeleter> AlignedBuffer;
+
+    AlignedBuffer makeAlignedBuffer(size_t size) {
+      void* p = 0;
+      if(posix_memalign(&p, kBufferAlignment, size) != 0) throw std::bad_alloc();
+      return AlignedBuffer(static_cast<char*>(p));
+    }
+
+    // Combine per-range checksums, in order, into the checksum of the whole.
+    uint32_t combineRanges(std::vector<uint32_t> const& partial, size_t rangeSize, size_t totalSize) {
+      uint32_t result = 1;
+      for(size_t i = 0; i < partial.size(); ++i) {
+        result = adler32Combine(result, partial[i], std::min(rangeSize, totalSize - i * rangeSize));
+      }
+      return result;
+    }
+
+    // The range size used to split totalSize bytes over nThreads threads.
+    size_t rangeSizeFor(size_t totalSize, unsigned int nThreads, size_t bufferSize) {
+      if(nThreads == 0) nThreads = 1;
+      size_t rangeSize = (totalSize + nThreads - 1) / nThreads;
+      // Never split into ranges smaller than one buffer, and keep range
+      // boundaries aligned for O_DIRECT.
+      rangeSize = std::max(rangeSize, bufferSize);
+      rangeSize = (rangeSize + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+      return rangeSize;
+    }
+
+    // The running state of the selected digests, one consumer per digest.
+    class DigestSet {
+    public:
+      explicit DigestSet(DigestSelection const& selection) :
+        selection_(selection), a_(1), b_(0), crc_(0), sha_() {
+        SHA256_Init(&sha_);
+      }
+
+      std::vector<ChunkConsumer> consumers() {
+        std::vector<ChunkConsumer> result;
+        if(selection_.adler32) {
+          result.push_back([this](char const* buffer, size_t n) { adler32Update(buffer, n, a_, b_); });
+        }
+        if(selection_.crc32c) {
+          result.push_back([this](char const* buffer, size_t n) { crc_ = crc32cUpdate(crc_, buffer, n); });
+        }
+        if(selection_.sha256) {
+          result.push_back([this](char const* buffer, size_t n) { SHA256_Update(&sha_, buffer, n); });
+        }
+        return result;
+      }
+
+      void finish(DigestValues& values) {
+        if(selection_.adler32) {
+          values.adler32 = (b_ << 16) | a_;
+        }
+        if(selection_.crc32c) {
+          values.crc32c = crc_;
+        }
+        if(selection_.sha256) {
+          unsigned char digest[SHA256_DIGEST_LENGTH];
+          SHA256_Final(digest, &sha_);
+          static char const hex[] = "0123456789abcdef";
+          values.sha256.clear();
+          for(int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+            values.sha256 += hex[digest[i] >> 4];
+            values.sha256 += hex[digest[i] & 0xf];
+          }
+        }
+      }
+
+    private:
+      DigestSelection selection_;
+      uint32_t a_;
+      uint32_t b_;
+      uint32_t crc_;
+      SHA256_CTX sha_;
+    };
+
+    // Reads exactly 'size' bytes at 'offset', or fewer only at end of file.
+    // With O_DIRECT the length is rounded up to the alignment, which the
+    // buffer always has room for, and every read must start on an aligned
+    // offset: after a short read the partial block is read again rather
+    // than continuing from the middle of it.
+    bool preadFully(int fd, char* buffer, size_t size, off_t offset, bool direct) {
+      size_t want = direct ? (size + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment : size;
+      size_t got = 0;
+      unsigned int retries = 0;
+      while(got < size) {
+        ssize_t n = pread(fd, buffer + got, want - got, offset + got);
+        if(n < 0) {
+          if(errno == EINTR) continue;
+          return false;
+        }
+        if(n == 0) return false;
+        size_t next = got + n;
+        if(direct && next < size && next % kBufferAlignment != 0) {
+          next = next / kBufferAlignment * kBufferAlignment;
+          // Give up if the device keeps returning less than one block.
+          if(next == got && ++retries > 3) {
+            errno = EIO;
+            return false;
+          }
+        }
+        if(next != got) retries = 0;
+        got = next;
+      }
+      return true;
+    }
+
+    // Drop 'size' bytes at 'offset' of a file mapped at 'data' from the page
+    // cache.  MADV_DONTNEED only unmaps them from this process (the cache
+    // keeps them), and the kernel will not evict pages which are still
+    // mapped, so both calls are needed.
+    void dropMappedRange(int fd, char const* data, size_t offset, size_t size) {
+      madvise(const_cast<char*>(data) + offset, size, MADV_DONTNEED);
+      posix_fadvise(fd, offset, size, POSIX_FADV_DONTNEED);
+    }
+  }
+
+  bool pipelinedRead(size_t totalSize, ChunkReader const& reader, ChunkConsumer const& consumer,
+                     unsigned int nBuffers, size_t bufferSize) {
+    return pipelinedRead(totalSize, reader, std::vector<ChunkConsumer>(1, consumer), nBuffers, bufferSize);
+  }
+
+  bool pipelinedRead(size_t totalSize, ChunkReader const& reader, std::vector<ChunkConsumer> const& consumers,
+                     unsigned int nBuffers, size_t bufferSize) {
+    if(bufferSize == 0) bufferSize = 1;
+    if(consumers.empty()) return true;
+    if(nBuffers <= 1 || (totalSize <= bufferSize && consumers.size() == 1)) {
+      // Nothing to overlap with; read and consume one chunk at a time.
+      AlignedBuffer buffer = makeAlignedBuffer(bufferSize);
+      for(size_t offset = 0; offset < totalSize; offset += bufferSize) {
+        size_t n = std::min(bufferSize, totalSize - offset);
+        if(!reader(buffer.get(), n)) return false;
+        for(auto const& consumer : consumers) {
+          consumer(buffer.get(), n);
+        }
+      }
+      return true;
+    }
+
+    // A ring of nBuffers buffers.  Chunk i lives in buffer i % nBuffers.
+    // 'produced' counts chunks read and consumed[c] the chunks consumer c
+    // has finished with.  The reader may run at most nBuffers chunks ahead
+    // of the slowest consumer.
+    std::vector<AlignedBuffer> buffers;
+    for(unsigned int i = 0; i < nBuffers; ++i) {
+      buffers.push_back(makeAlignedBuffer(bufferSize));
+    }
+    std::vector<size_t> sizes(nBuffers, 0);
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t produced = 0;
+    std::vector<size_t> consumed(consumers.size(), 0);
+    bool finished = false;
+    bool failed = false;
+    bool abandoned = false;
+    std::exception_ptr consumerException;
+
+    std::thread readerThread([&]() {
+      for(size_t offset = 0; offset < totalSize; offset += bufferSize) {
+        size_t slot;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() {
+            return abandoned || produced - *std::min_element(consumed.begin(), consumed.end()) < nBuffers;
+          });
+          if(abandoned) break;
+          slot = produced % nBuffers;
+        }
+        size_t n = std::min(bufferSize, totalSize - offset);
+        bool ok = reader(buffers[slot].get(), n);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if(!ok) {
+            failed = true;
+            break;
+          }
+          sizes[slot] = n;
+          ++produced;
+        }
+        cond.notify_all();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+      }
+      cond.notify_all();
+    });
+
+    // Consumer c takes every chunk in turn.  A consumer that throws stops
+    // the whole pipeline.
+    auto consume = [&](size_t c) {
+      try {
+        for(;;) {
+          size_t slot;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() { return abandoned || consumed[c] < produced || finished; });
+            if(abandoned || consumed[c] == produced) break;
+            slot = consumed[c] % nBuffers;
+          }
+          consumers[c](buffers[slot].get(), sizes[slot]);
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++consumed[c];
+          }
+          cond.notify_all();
+        }
+      } catch(...) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          abandoned = true;
+          if(!consumerException) consumerException = std::current_exception();
+        }
+        cond.notify_all();
+      }
+    };
+
+    std::vector<std::thread> consumerThreads;
+    for(size_t c = 1; c < consumers.size(); ++c) {
+      consumerThreads.emplace_back(consume, c);
+    }
+    consume(0);
+    for(auto& thread : consumerThreads) {
+      thread.join();
+    }
+    readerThread.join();
+    if(consumerException) std::rethrow_exception(consumerException);
+    return !failed;
+  }
+
+  DigestValues fileDigests(TFile* tfile, DigestSelection const& selection, unsigned int nBuffers, size_t bufferSize) {
+    DigestSet digests(selection);
+    size_t fileSize = tfile->GetSize();
+    tfile->Seek(0, TFile::kBeg);
+    bool ok = pipelinedRead(fileSize,
+      [tfile](char* buffer, size_t size) { return !tfile->ReadBuffer(buffer, size); },
+      digests.consumers(), nBuffers, bufferSize);
+    if(!ok) {
+      throw cms::Exception("FileReadError", "fileDigests")
+        << "Error reading " << tfile->GetName() << " while computing its checksums.\n";
+    }
+    DigestValues values;
+    values.bytes = fileSize;
+    digests.finish(values);
+    return values;
+  }
+
+  uint32_t fileAdler32Parallel(std::string const& pfn, size_t fileSize, unsigned int nThreads,
+                               unsigned int nBuffers, size_t bufferSize) {
+    size_t rangeSize = rangeSizeFor(fileSize, nThreads, bufferSize);
+    unsigned int nRanges = fileSize == 0 ? 0 : (fileSize + rangeSize - 1) / rangeSize;
+
+    std::vector<uint32_t> partial(nRanges, 1);
+    std::vector<char> failed(nRanges, 0);
+    std::string const rawName = pfn + (pfn.find('?') == std::string::npos ? "?filetype=raw" : "&filetype=raw");
+    parallelFor(nRanges, nThreads, [&](unsigned int i) {
+      size_t begin = i * rangeSize;
+      size_t size = std::min(rangeSize, fileSize - begin);
+      std::unique_ptr<TFile> file(TFile::Open(rawName.c_str(), "read"));
+      if(!file) {
+        failed[i] = 1;
+        return;
+      }
+      uint32_t a = 1, b = 0;
+      file->Seek(begin, TFile::kBeg);
+      TFile* tfile = file.get();
+      bool ok = pipelinedRead(size,
+        [tfile](char* buffer, size_t n) { return !tfile->ReadBuffer(buffer, n); },
+        [&a, &b](char const* buffer, size_t n) { adler32Update(buffer, n, a, b); },
+        nBuffers, bufferSize);
+      file->Close();
+      if(!ok) {
+        failed[i] = 1;
+        return;
+      }
+      partial[i] = (b << 16) | a;
+    });
+
+    for(unsigned int i = 0; i < nRanges; ++i) {
+      if(failed[i]) {
+        throw cms::Exception("FileReadError", "fileAdler32Parallel")
+          << "Error reading bytes " << i * rangeSize << " to " << std::min((i + 1) * rangeSize, fileSize)
+          << " of " << pfn << " while computing its adler32 checksum.\n";
+      }
+    }
+    return combineRanges(partial, rangeSize, fileSize);
+  }
+
+  bool localFilePath(std::string const& pfn, std::string& path) {
+    static std::string const kFilePrefix("file:");
+    if(pfn.compare(0, kFilePrefix.size(), kFilePrefix) == 0) {
+      path = pfn.substr(kFilePrefix.size());
+      // Accept file:///abs/path as well as file:/abs/path and file:rel/path.
+      if(path.compare(0, 3, "///") == 0) path.erase(0, 2);
+      return true;
+    }
+    // Anything else with a "protocol:" prefix (root:, dcap:, rfio:, ...) is remote.
+    std::string::size_type colon = pfn.find(':');
+    std::string::size_type slash = pfn.find('/');
+    if(colon != std::string::npos && (slash == std::string::npos || colon < slash)) {
+      return false;
+    }
+    path = pfn;
+    return true;
+  }
+
+  DigestValues localFileDigests(std::string const& path, LocalReadMode mode, DigestSelection const& selection,
+                                unsigned int nThreads, unsigned int nBuffers, size_t bufferSize) {
+    bool direct = (mode == kDirectRead);
+    int fd = -1;
+    if(direct) {
+      fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+      // Some file systems (tmpfs for example) refuse O_DIRECT.
+      // Fall back to ordinary reads rather than failing.
+      if(fd < 0 && errno == EINVAL) {
+        direct = false;
+      }
+    }
+    if(fd < 0) {
+      fd = open(path.c_str(), O_RDONLY);
+    }
+    if(fd < 0) {
+      throw cms::Exception("FileOpenError", "localFileDigests")
+        << "Could not open " << path << ": " << strerror(errno) << "\n";
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      int err = errno;
+      close(fd);
+      throw cms::Exception("FileOpenError", "localFileDigests")
+        << "Could not stat " << path << ": " << strerror(err) << "\n";
+    }
+    size_t const fileSize = st.st_size;
+
+    // Only adler32 can be split into independently computed ranges.
+    if(!selection.onlyAdler32()) nThreads = 1;
+    bufferSize = (bufferSize + kBufferAlignment - 1) / kBufferAlignment * kBufferAlignment;
+    size_t rangeSize = rangeSizeFor(fileSize, nThreads, bufferSize);
+    unsigned int nRanges = fileSize == 0 ? 0 : (fileSize + rangeSize - 1) / rangeSize;
+    std::vector<uint32_t> partial(nRanges, 1);
+    DigestSet digests(selection);
+    bool ok = true;
+
+    if(mode == kMmapRead) {
+      void* mapped = 0;
+      if(fileSize != 0) {
+        mapped = mmap(0, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped == MAP_FAILED) {
+          int err = errno;
+          close(fd);
+          throw cms::Exception("FileReadError", "localFileDigests")
+            << "Could not mmap " << path << ": " << strerror(err) << "\n";
+        }
+        madvise(mapped, fileSize, MADV_SEQUENTIAL);
+      }
+      char const* data = static_cast<char const*>(mapped);
+      if(nThreads > 1) {
+        parallelFor(nRanges, nThreads, [&](unsigned int i) {
+          size_t begin = i * rangeSize;
+          size_t size = std::min(rangeSize, fileSize - begin);
+          uint32_t a = 1, b = 0;
+          // One buffer's worth at a time, dropping the pages already summed.
+          for(size_t offset = 0; offset < size; offset += bufferSize) {
+            size_t n = std::min(bufferSize, size - offset);
+            adler32Update(data + begin + offset, n, a, b);
+            dropMappedRange(fd, data, begin + offset, n);
+          }
+          partial[i] = (b << 16) | a;
+        });
+      } else {
+        // Each digest walks the mapping on its own thread.  Pages are
+        // dropped once every digest has passed them.
+        std::vector<ChunkConsumer> consumers = digests.consumers();
+        std::vector<size_t> done(consumers.size(), 0);
+        size_t dropped = 0;
+        std::mutex mutex;
+        parallelFor(consumers.size(), consumers.size(), [&](unsigned int c) {
+          for(size_t offset = 0; offset < fileSize; offset += bufferSize) {
+            size_t n = std::min(bufferSize, fileSize - offset);
+            consumers[c](data + offset, n);
+            std::lock_guard<std::mutex> lock(mutex);
+            done[c] = offset + n;
+            size_t slowest = *std::min_element(done.begin(), done.end());
+            if(slowest > dropped) {
+              dropMappedRange(fd, data, dropped, slowest - dropped);
+              dropped = slowest;
+            }
+          }
+        });
+      }
+      if(mapped != 0) munmap(mapped, fileSize);
+    } else if(nThreads > 1) {
+      std::vector<char> failed(nRanges, 0);
+      parallelFor(nRanges, nThreads, [&](unsigned int i) {
+        off_t offset = static_cast<off_t>(i) * rangeSize;
+        size_t size = std::min<size_t>(rangeSize, fileSize - offset);
+        uint32_t a = 1, b = 0;
+        bool rangeOk = pipelinedRead(size,
+          [&](char* buffer, size_t n) {
+            bool good = preadFully(fd, buffer, n, offset, direct);
+            offset += n;
+            return good;
+          },
+          [&a, &b](char const* buffer, size_t n) { adler32Update(buffer, n, a, b); },
+          nBuffers, bufferSize);
+        if(!rangeOk) failed[i] = 1;
+        partial[i] = (b << 16) | a;
+      });
+      ok = std::find(failed.begin(), failed.end(), 1) == failed.end();
+    } else {
+      off_t offset = 0;
+      ok = pipelinedRead(fileSize,
+        [&](char* buffer, size_t n) {
+          bool good = preadFully(fd, buffer, n, offset, direct);
+          offset += n;
+          return good;
+        },
+        digests.consumers(), nBuffers, bufferSize);
+    }
+    if(!direct) {
+      // We will not read this file again; do not leave it in the page cache.
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+    if(!ok) {
+      throw cms::Exception("FileReadError", "localFileDigests")
+        << "Error reading " << path << " while computing its checksums.\n";
+    }
+    DigestValues values;
+    values.bytes = fileSize;
+    if(nThreads > 1) {
+      values.adler32 = combineRanges(partial, rangeSize, fileSize);
+    } else {
+      digests.finish(values);
+    }
+    return values;
+  }
+}
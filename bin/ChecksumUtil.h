@@ -0,0 +1,88 @@
+#ifndef IOPool_Common_ChecksumUtil_h
+#define IOPool_Common_ChecksumUtil_h
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class TFile;
+
+namespace edm {
+
+  // Fills 'buffer' with the next 'size' bytes of the input.
+  // Returns false if the read failed.
+  typedef std::function<bool (char* buffer, size_t size)> ChunkReader;
+
+  // Called with each chunk of the input, in order.
+  typedef std::function<void (char const* buffer, size_t size)> ChunkConsumer;
+
+  // Reads 'totalSize' bytes through 'reader' in chunks of at most
+  // 'bufferSize' bytes, and passes each chunk to 'consumer' on the calling
+  // thread.  With more than one buffer the reads are done on a separate
+  // thread, so that chunk N+1 is being read while chunk N is consumed.
+  // The buffers handed to 'reader' are page aligned and always 'bufferSize'
+  // bytes long, even for the last, shorter chunk.
+  // Returns false if any read failed.
+  bool pipelinedRead(size_t totalSize, ChunkReader const& reader, ChunkConsumer const& consumer,
+                     unsigned int nBuffers, size_t bufferSize);
+
+  // As above, but every chunk is passed to each of 'consumers'.  With more
+  // than one buffer each consumer runs on its own thread (the first on the
+  // calling thread), and a buffer is reused only once all of them are done
+  // with it.
+  bool pipelinedRead(size_t totalSize, ChunkReader const& reader, std::vector<ChunkConsumer> const& consumers,
+                     unsigned int nBuffers, size_t bufferSize);
+
+  // The digests which can be computed in a single pass over a file.
+  struct DigestSelection {
+    DigestSelection() : adler32(false), crc32c(false), sha256(false) {}
+    bool any() const { return adler32 || crc32c || sha256; }
+    bool onlyAdler32() const { return adler32 && !crc32c && !sha256; }
+    bool adler32;
+    bool crc32c;
+    bool sha256;
+  };
+
+  // The values of the selected digests.  The others are left unset.
+  struct DigestValues {
+    DigestValues() : bytes(0), adler32(1), crc32c(0), sha256() {}
+    uint64_t bytes;
+    uint32_t adler32;
+    uint32_t crc32c;
+    std::string sha256; // lower case hex
+  };
+
+  // The selected digests of the whole of 'tfile', read through ROOT once.
+  // Throws if the file could not be read.
+  DigestValues fileDigests(TFile* tfile, DigestSelection const& selection, unsigned int nBuffers, size_t bufferSize);
+
+  // The adler32 checksum of the first 'fileSize' bytes of 'pfn', computed
+  // by splitting the file into nThreads contiguous ranges.  Each range is
+  // read through its own raw (unparsed) TFile on its own thread, and the
+  // partial checksums are combined with adler32Combine.
+  // Throws if the file could not be read.
+  uint32_t fileAdler32Parallel(std::string const& pfn, size_t fileSize, unsigned int nThreads,
+                               unsigned int nBuffers, size_t bufferSize);
+
+  // How a local file is read by localFileAdler32.
+  enum LocalReadMode {
+    kMmapRead,   // mmap the file with MADV_SEQUENTIAL
+    kDirectRead  // page aligned O_DIRECT reads, bypassing the page cache
+  };
+
+  // If 'pfn' names a local file (a "file:" URL or a plain path) set 'path'
+  // to the path to use with the operating system and return true.
+  bool localFilePath(std::string const& pfn, std::string& path);
+
+  // The selected digests of the local file 'path', read once, directly
+  // with the operating system and without ROOT.  The file need not be a
+  // ROOT file.  If adler32 is the only digest and nThreads > 1 the file is
+  // split into ranges as in fileAdler32Parallel.
+  // Throws if the file could not be read.
+  DigestValues localFileDigests(std::string const& path, LocalReadMode mode, DigestSelection const& selection,
+                                unsigned int nThreads, unsigned int nBuffers, size_t bufferSize);
+}
+
+#endif
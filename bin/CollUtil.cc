@@ -1,36 +1,177 @@
 #include "IOPool/Common/bin/CollUtil.h"
+#include "IOPool/Common/bin/ParallelFor.h"
+#include "IOPool/Common/interface/TreeEntryCount.h"
 
 #include "DataFormats/Provenance/interface/BranchType.h"
-#include "DataFormats/Provenance/interface/EventAuxiliary.h"
 #include "DataFormats/Provenance/interface/FileFormatVersion.h"
-#include "DataFormats/Provenance/interface/FileID.h"
 #include "DataFormats/Provenance/interface/FileIndex.h"
 #include "DataFormats/Provenance/interface/IndexIntoFile.h"
+#include "DataFormats/Provenance/interface/ProcessHistoryRegistry.h"
 
+#include "TBasket.h"
 #include "TBranch.h"
 #include "TFile.h"
 #include "TIterator.h"
 #include "TKey.h"
 #include "TList.h"
+#include "TObjArray.h"
 #include "TObject.h"
 #include "TTree.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
 
 namespace edm {
 
+  std::string jsonEscape(std::string const& s) {
+    std::string result;
+    result.reserve(s.size());
+    for(std::string::const_iterator it = s.begin(), itEnd = s.end(); it != itEnd; ++it) {
+      switch(*it) {
+        case '"':  result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\t': result += "\\t"; break;
+        default:
+          // JSON allows no raw control characters in strings.
+          if(static_cast<unsigned char>(*it) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*it));
+            result += escaped;
+          } else {
+            result += *it;
+          }
+          break;
+      }
+    }
+    return result;
+  }
+
+  namespace {
+    // Start an NDJSON record of kind 'record' for file 'fileName'.
+    // The caller adds the remaining members and the closing "}\n".
+    std::ostream& beginRecord(std::ostream& out, char const* record, std::string const& fileName) {
+      return out << "{\"record\":\"" << record << "\",\"file\":\"" << jsonEscape(fileName) << '"';
+    }
+
+    void printMissing(std::ostream& out, ReportFormat format, std::string const& fileName, char const* what, char const* text) {
+      if(format == kNDJSONReport) {
+        beginRecord(out, "error", fileName) << ",\"error\":\"" << what << " not found\"}\n";
+      } else {
+        out << text;
+      }
+    }
+
+    char const* const kMissingFileIndex =
+      "FileIndex not found.  If this input file was created with release 1_8_0 or later\n"
+      "this indicates a problem with the file.  This condition should be expected with\n"
+      "files created with earlier releases and printout of the event list will fail.\n";
+
+    char const* const kMissingIndexIntoFile =
+      "IndexIntoFile not found.  If this input file was created with release 1_8_0 or later\n"
+      "this indicates a problem with the file.  This condition should be expected with\n"
+      "files created with earlier releases and printout of the event list will fail.\n";
+
+    // The fast copy conclusions printed at the end of the event list.
+    void printFastCopyInfo(std::ostream& out, ReportFormat format, std::string const& fileName, EventTable const& table) {
+      if(format == kNDJSONReport) {
+        beginRecord(out, "fastCopy", fileName)
+          << ",\"fileFormatVersion\":" << table.fileFormatVersion
+          << ",\"versionSupportsFastCopy\":" << (table.versionSupportsFastCopy ? "true" : "false")
+          << ",\"fastCopyPossible\":" << (table.fastCopyPossible ? "true" : "false");
+        if(table.noEventSortKnown) {
+          out << ",\"fastCopyPossibleNoEventSort\":" << (table.fastCopyPossibleNoEventSort ? "true" : "false");
+        }
+        out << "}\n";
+        return;
+      }
+      // The spelling of the configuration parameter in the releases which
+      // wrote each kind of index.
+      char const* falseSpelling = table.source == EventTable::kFileIndex ? "False" : "false";
+      out << "\nFileFormatVersion = " << table.fileFormatVersion << ".  ";
+      if (table.versionSupportsFastCopy) out << "This version supports fast copy\n";
+      else out << "This version does not support fast copy\n";
+
+      if (table.fastCopyPossible) {
+        out << "Events are sorted such that fast copy is possible in the \"noEventSort = " << falseSpelling << "\" mode\n";
+      } else {
+        out << "Events are sorted such that fast copy is NOT possible in the \"noEventSort = " << falseSpelling << "\" mode\n";
+      }
+
+      if (table.noEventSortKnown) {
+        if (table.fastCopyPossibleNoEventSort) {
+          out << "Events are sorted such that fast copy is possible in the \"noEventSort\" mode\n";
+        } else {
+          out << "Events are sorted such that fast copy is NOT possible in the \"noEventSort\" mode\n";
+        }
+      }
+      out << "(Note that other factors can prevent fast copy from occurring)\n\n";
+    }
+
+    // One row of the per lumi event count table.
+    void printLumiCount(std::ostream& out, ReportFormat format, std::string const& fileName,
+                        unsigned long runID, unsigned long lumiID, unsigned long nEvents) {
+      if(format == kNDJSONReport) {
+        beginRecord(out, "eventsInLumi", fileName)
+          << ",\"run\":" << runID << ",\"lumi\":" << lumiID << ",\"events\":" << nEvents << "}\n";
+      } else {
+        out << std::setw(15) << runID
+        << std::setw(15) << lumiID
+        << std::setw(15) << nEvents<<"\n";
+      }
+    }
+
+    // Why a file's run/lumi/event index could not be read.
+    void printEventTableProblem(std::ostream& out, ReportFormat format, std::string const& fileName, EventTable::Problem problem) {
+      switch(problem) {
+        case EventTable::kNoMetaData:
+          printMissing(out, format, fileName, "MetaData tree", "Missing MetaData tree?\n");
+          break;
+        case EventTable::kNoFileIndex:
+          printMissing(out, format, fileName, "FileIndex", kMissingFileIndex);
+          break;
+        case EventTable::kNoIndexIntoFile:
+          printMissing(out, format, fileName, "IndexIntoFile", kMissingIndexIntoFile);
+          break;
+        case EventTable::kNoEventAuxiliary:
+          if (format == kNDJSONReport) {
+            beginRecord(out, "error", fileName) << ",\"error\":\"EventAuxiliary branch not found\"}\n";
+          } else {
+            out << "Failed to find EventAuxiliary branch in Events TTree.  Something is wrong with this file." << std::endl;
+          }
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
   // Get a file handler
   TFile* openFileHdl(std::string const& fname) {
-    TFile *hdl = TFile::Open(fname.c_str(), "read");
+    TFile *hdl = openFileHdl(fname, std::cout);
 
     if (0 == hdl) {
-      std::cout << "ERR Could not open file " << fname.c_str() << std::endl;
       exit(1);
     }
     return hdl;
   }
 
+  // Get a file handler, reporting failure to 'err' and returning 0
+  // instead of exiting.
+  TFile* openFileHdl(std::string const& fname, std::ostream& err) {
+    TFile *hdl = TFile::Open(fname.c_str(), "read");
+
+    if (0 == hdl) {
+      err << "ERR Could not open file " << fname.c_str() << std::endl;
+    }
+    return hdl;
+  }
+
   // Print every tree in a file
   void printTrees(TFile *hdl) {
     hdl->ls();
@@ -48,187 +189,278 @@ namespace edm {
 
   // number of entries in a tree
   Long64_t numEntries(TFile *hdl, std::string const& trname) {
+    return numEntries(hdl, trname, std::cout);
+  }
+
+  Long64_t numEntries(TFile *hdl, std::string const& trname, std::ostream& err) {
     TTree *tree = (TTree*)hdl->Get(trname.c_str());
     if (tree) {
       return tree->GetEntries();
     } else {
-      std::cout << "ERR cannot find a TTree named \"" << trname << "\""
-                << std::endl;
+      err << "ERR cannot find a TTree named \"" << trname << "\""
+          << std::endl;
+      return -1;
+    }
+  }
+
+  Long64_t numEntriesFromKey(TFile *hdl, std::string const& trname) {
+    return numEntriesFromKey(hdl, trname, std::cout);
+  }
+
+  Long64_t numEntriesFromKey(TFile *hdl, std::string const& trname, std::ostream& err) {
+    Long64_t const entries = treeEntriesFromKey(hdl, trname.c_str());
+    if (entries == kUndecodedTree) {
+      return numEntries(hdl, trname, err);
+    }
+    if (entries == kNoSuchTree) {
+      err << "ERR cannot find a TTree named \"" << trname << "\""
+          << std::endl;
       return -1;
     }
+    return entries;
   }
 
   namespace {
-    void addBranchSizes(TBranch *branch, Long64_t& size) {
-      size += branch->GetTotalSize(); // Includes size of branch metadata
-      // Now recurse through any subbranches.
+    void printBranchDetailsNDJSON(std::ostream& out, TBranch *branch, std::string const& fileName, std::string const& treeName, std::string const& parent) {
+      beginRecord(out, "branchDetails", fileName)
+        << ",\"tree\":\"" << jsonEscape(treeName) << '"'
+        << ",\"branch\":\"" << jsonEscape(branch->GetName()) << '"'
+        << ",\"parent\":\"" << jsonEscape(parent) << '"'
+        << ",\"title\":\"" << jsonEscape(branch->GetTitle()) << '"'
+        << ",\"entries\":" << branch->GetEntries()
+        << ",\"totBytes\":" << branch->GetTotBytes()
+        << ",\"zipBytes\":" << branch->GetZipBytes()
+        << ",\"baskets\":" << branch->GetWriteBasket()
+        << ",\"basketSize\":" << branch->GetBasketSize()
+        << ",\"compression\":" << branch->GetCompressionSettings()
+        << "}\n";
       Long64_t nB = branch->GetListOfBranches()->GetEntries();
       for (Long64_t i = 0; i < nB; ++i) {
-        TBranch *btemp = (TBranch *)branch->GetListOfBranches()->At(i);
-        addBranchSizes(btemp, size);
+        printBranchDetailsNDJSON(out, (TBranch *)branch->GetListOfBranches()->At(i), fileName, treeName, branch->GetName());
       }
     }
   }
 
-  void printBranchNames(TTree *tree) {
+  void printBranchNames(TTree *tree, ReportFormat format, std::string const& fileName, std::ostream& out) {
     if (tree != 0) {
-      Long64_t nB = tree->GetListOfBranches()->GetEntries();
-      for (Long64_t i = 0; i < nB; ++i) {
-        Long64_t size = 0LL;
-        TBranch *btemp = (TBranch *)tree->GetListOfBranches()->At(i);
-        addBranchSizes(btemp, size);
-        std::cout << "Branch " << i << " of " << tree->GetName() << " tree: " << btemp->GetName() << " Total size = " << size << std::endl;
+      std::vector<BranchSizeInfo> const branches = readBranchSizes(tree);
+      for (std::vector<BranchSizeInfo>::size_type i = 0; i < branches.size(); ++i) {
+        if (format == kNDJSONReport) {
+          beginRecord(out, "branch", fileName)
+            << ",\"tree\":\"" << jsonEscape(tree->GetName()) << '"'
+            << ",\"index\":" << i
+            << ",\"branch\":\"" << jsonEscape(branches[i].name) << '"'
+            << ",\"totalSize\":" << branches[i].totalSize << "}\n";
+        } else {
+          out << "Branch " << i << " of " << tree->GetName() << " tree: " << branches[i].name << " Total size = " << branches[i].totalSize << std::endl;
+        }
       }
     } else {
-      std::cout << "Missing Events tree?\n";
+      printMissing(out, format, fileName, "tree", "Missing Events tree?\n");
     }
   }
 
-  void longBranchPrint(TTree *tr) {
+  void longBranchPrint(TTree *tr, ReportFormat format, std::string const& fileName, std::ostream& out) {
     if (tr != 0) {
       Long64_t nB = tr->GetListOfBranches()->GetEntries();
       for (Long64_t i = 0; i < nB; ++i) {
-        tr->GetListOfBranches()->At(i)->Print();
+        if (format == kNDJSONReport) {
+          printBranchDetailsNDJSON(out, (TBranch *)tr->GetListOfBranches()->At(i), fileName, tr->GetName(), std::string());
+        } else {
+          tr->GetListOfBranches()->At(i)->Print();
+        }
       }
     } else {
-      std::cout << "Missing Events tree?\n";
+      printMissing(out, format, fileName, "tree", "Missing Events tree?\n");
     }
   }
 
-  std::string getUuid(TTree *uuidTree) {
-    FileID fid;
-    FileID *fidPtr = &fid;
-    uuidTree->SetBranchAddress(poolNames::fileIdentifierBranchName().c_str(), &fidPtr);
-    uuidTree->GetEntry(0);
-    return fid.fid();
+  namespace {
+    char const* const kBranchStatsColumns[] = {
+      "branch", "zipBytes", "totBytes", "ratio", "baskets",
+      "minBasket", "medianBasket", "maxBasket", "entriesPerBasket", "fraction"
+    };
+
+    // Orders rows by one column, largest first for numbers.
+    class BranchStatsOrder {
+    public:
+      explicit BranchStatsOrder(std::string const& column) : column_(column) {}
+      bool operator()(BranchSizeInfo const& a, BranchSizeInfo const& b) const {
+        if (column_ == "branch") return a.name < b.name;
+        double va = value(a);
+        double vb = value(b);
+        if (va != vb) return va > vb;
+        return a.name < b.name;
+      }
+    private:
+      double value(BranchSizeInfo const& s) const {
+        if (column_ == "totBytes") return s.totBytes;
+        if (column_ == "ratio") return s.ratio();
+        if (column_ == "baskets") return s.baskets;
+        if (column_ == "minBasket") return s.minBasket;
+        if (column_ == "medianBasket") return s.medianBasket;
+        if (column_ == "maxBasket") return s.maxBasket;
+        if (column_ == "entriesPerBasket") return s.entriesPerBasket();
+        // "zipBytes" and "fraction" give the same order.
+        return s.zipBytes;
+      }
+      std::string column_;
+    };
   }
 
-  void printUuids(TTree *uuidTree) {
-    FileID fid;
-    FileID *fidPtr = &fid;
-    uuidTree->SetBranchAddress(poolNames::fileIdentifierBranchName().c_str(), &fidPtr);
-    uuidTree->GetEntry(0);
-
-    std::cout << "UUID: " << fid.fid() << std::endl;
+  bool isBranchStatsColumn(std::string const& column) {
+    for (char const* const* it = kBranchStatsColumns; it != kBranchStatsColumns + sizeof(kBranchStatsColumns)/sizeof(kBranchStatsColumns[0]); ++it) {
+      if (column == *it) return true;
+    }
+    return false;
   }
 
-  static void preIndexIntoFilePrintEventLists(TFile*, FileFormatVersion const& fileFormatVersion, TTree *metaDataTree) {
-    FileIndex fileIndex;
-    FileIndex *findexPtr = &fileIndex;
-    if (metaDataTree->FindBranch(poolNames::fileIndexBranchName().c_str()) != 0) {
-      TBranch *fndx = metaDataTree->GetBranch(poolNames::fileIndexBranchName().c_str());
-      fndx->SetAddress(&findexPtr);
-      fndx->GetEntry(0);
-    } else {
-      std::cout << "FileIndex not found.  If this input file was created with release 1_8_0 or later\n"
-                   "this indicates a problem with the file.  This condition should be expected with\n"
-        "files created with earlier releases and printout of the event list will fail.\n";
+  void printBranchStats(TTree *tree, std::string const& sortBy, ReportFormat format, std::string const& fileName, std::ostream& out) {
+    if (tree == 0) {
+      printMissing(out, format, fileName, "tree", "Missing Events tree?\n");
       return;
     }
-
-    std::cout << "\n" << fileIndex;
-
-    std::cout << "\nFileFormatVersion = " << fileFormatVersion << ".  ";
-    if (fileFormatVersion.fastCopyPossible()) std::cout << "This version supports fast copy\n";
-    else std::cout << "This version does not support fast copy\n";
-
-    if (fileIndex.allEventsInEntryOrder()) {
-      std::cout << "Events are sorted such that fast copy is possible in the \"noEventSort = False\" mode\n";
-    } else {
-      std::cout << "Events are sorted such that fast copy is NOT possible in the \"noEventSort = False\" mode\n";
+    std::vector<BranchSizeInfo> rows = readBranchSizes(tree);
+    std::stable_sort(rows.begin(), rows.end(), BranchStatsOrder(sortBy));
+
+    Long64_t fileSize = tree->GetCurrentFile() != 0 ? tree->GetCurrentFile()->GetSize() : 0;
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    if (format == kTextReport) {
+      out << "\nBranch storage statistics for the " << tree->GetName() << " tree, sorted by " << sortBy << "\n"
+                << std::setw(14) << "zipBytes"
+                << std::setw(14) << "totBytes"
+                << std::setw(8) << "ratio"
+                << std::setw(9) << "baskets"
+                << std::setw(11) << "minBasket"
+                << std::setw(11) << "medBasket"
+                << std::setw(11) << "maxBasket"
+                << std::setw(11) << "entr/bskt"
+                << std::setw(9) << "% file"
+                << "  branch\n";
+    }
+    for (std::vector<BranchSizeInfo>::const_iterator it = rows.begin(), itEnd = rows.end(); it != itEnd; ++it) {
+      double fraction = fileSize > 0 ? double(it->zipBytes) / fileSize : 0.;
+      if (format == kNDJSONReport) {
+        beginRecord(out, "branchStats", fileName)
+          << ",\"tree\":\"" << jsonEscape(tree->GetName()) << '"'
+          << ",\"branch\":\"" << jsonEscape(it->name) << '"'
+          << ",\"zipBytes\":" << it->zipBytes
+          << ",\"totBytes\":" << it->totBytes
+          << ",\"ratio\":" << it->ratio()
+          << ",\"baskets\":" << it->baskets
+          << ",\"minBasket\":" << it->minBasket
+          << ",\"medianBasket\":" << it->medianBasket
+          << ",\"maxBasket\":" << it->maxBasket
+          << ",\"entriesPerBasket\":" << it->entriesPerBasket()
+          << ",\"fraction\":" << fraction << "}\n";
+      } else {
+        out << std::setw(14) << it->zipBytes
+                  << std::setw(14) << it->totBytes
+                  << std::setw(8) << std::fixed << std::setprecision(2) << it->ratio()
+                  << std::setw(9) << it->baskets
+                  << std::setw(11) << it->minBasket
+                  << std::setw(11) << it->medianBasket
+                  << std::setw(11) << it->maxBasket
+                  << std::setw(11) << std::setprecision(1) << it->entriesPerBasket()
+                  << std::setw(9) << std::setprecision(2) << 100. * fraction
+                  << "  " << it->name << "\n";
+      }
     }
+    out.flags(flags);
+    out.precision(precision);
+    if (format == kTextReport) out << "\n";
+  }
 
-    fileIndex.sortBy_Run_Lumi_EventEntry();
-    if (fileIndex.allEventsInEntryOrder()) {
-      std::cout << "Events are sorted such that fast copy is possible in the \"noEventSort\" mode\n";
-    } else {
-      std::cout << "Events are sorted such that fast copy is NOT possible in the \"noEventSort\" mode\n";
+  void printUuids(TTree *uuidTree) {
+    std::cout << "UUID: " << readUuid(uuidTree) << std::endl;
+  }
+
+  namespace {
+    char const* rowTypeName(EventTableRow::Type type) {
+      return type == EventTableRow::kRun ? "run" : (type == EventTableRow::kLumi ? "lumi" : "event");
     }
-    std::cout << "(Note that other factors can prevent fast copy from occurring)\n\n";
   }
 
-  static void postIndexIntoFilePrintEventLists(TFile* tfl, FileFormatVersion const& fileFormatVersion, TTree *metaDataTree) {
-    IndexIntoFile indexIntoFile;
-    IndexIntoFile *findexPtr = &indexIntoFile;
-    if (metaDataTree->FindBranch(poolNames::indexIntoFileBranchName().c_str()) != 0) {
-      TBranch *fndx = metaDataTree->GetBranch(poolNames::indexIntoFileBranchName().c_str());
-      fndx->SetAddress(&findexPtr);
-      fndx->GetEntry(0);
-    } else {
-      std::cout << "IndexIntoFile not found.  If this input file was created with release 1_8_0 or later\n"
-                   "this indicates a problem with the file.  This condition should be expected with\n"
-                   "files created with earlier releases and printout of the event list will fail.\n";
+  void printEventLists(TFile *tfl, ReportFormat format, std::string const& fileName, std::ostream& out) {
+    EventTable table;
+    if (!readEventTable(tfl, table)) {
+      printEventTableProblem(out, format, fileName, table.problem);
       return;
     }
-    //need to read event # from the EventAuxiliary branch
-    TTree* eventsTree = dynamic_cast<TTree*>(tfl->Get(poolNames::eventTreeName().c_str()));
-    TBranch* eventAuxBranch = 0;
-    assert(0 != eventsTree);
-    char const* const kEventAuxiliaryBranchName = "EventAuxiliary";
-    if(eventsTree->FindBranch(kEventAuxiliaryBranchName) != 0){
-      eventAuxBranch = eventsTree->GetBranch(kEventAuxiliaryBranchName);
+    if (format == kNDJSONReport) {
+      for(std::vector<EventTableRow>::const_iterator it = table.rows.begin(), itEnd = table.rows.end(); it != itEnd; ++it) {
+        beginRecord(out, "entry", fileName)
+          << ",\"type\":\"" << rowTypeName(it->type) << '"'
+          << ",\"run\":" << it->run
+          << ",\"lumi\":" << it->lumi
+          << ",\"event\":" << it->event
+          << ",\"entry\":" << it->entry << "}\n";
+      }
+    } else if (table.source == EventTable::kFileIndex) {
+      // Old files get FileIndex's own listing.
+      FileIndex fileIndex;
+      for(std::vector<EventTableRow>::const_iterator it = table.rows.begin(), itEnd = table.rows.end(); it != itEnd; ++it) {
+        fileIndex.addEntry(it->run, it->lumi, it->event, it->entry);
+      }
+      out << "\n" << fileIndex;
     } else {
-      std::cout << "Failed to find " << kEventAuxiliaryBranchName << " branch in Events TTree.  Something is wrong with this file." << std::endl;
-      return;
-    }
-    EventAuxiliary eventAuxiliary;
-    EventAuxiliary* eAPtr = &eventAuxiliary;
-    eventAuxBranch->SetAddress(&eAPtr);
-    std::cout << "\nPrinting IndexIntoFile contents.  This includes a list of all Runs, LuminosityBlocks\n"
-       << "and Events stored in the root file.\n\n";
-    std::cout << std::setw(15) << "Run"
-       << std::setw(15) << "Lumi"
-       << std::setw(15) << "Event"
-       << std::setw(15) << "TTree Entry"
-       << "\n";
-
-    for(IndexIntoFile::IndexIntoFileItr it = indexIntoFile.begin(IndexIntoFile::firstAppearanceOrder),
-                                        itEnd = indexIntoFile.end(IndexIntoFile::firstAppearanceOrder);
-                                        it != itEnd; ++it) {
-      IndexIntoFile::EntryType t = it.getEntryType();
-      std::cout << std::setw(15) << it.run() << std::setw(15) << it.lumi();
-      EventNumber_t eventNum = 0;
-      std::string type;
-      switch(t) {
-        case IndexIntoFile::kRun:
-          type = "(Run)";
-        break;
-        case IndexIntoFile::kLumi:
-          type = "(Lumi)";
-        break;
-        case IndexIntoFile::kEvent:
-          eventAuxBranch->GetEntry(it.entry());
-          eventNum = eventAuxiliary.id().event();
-        break;
-        default:
-        break;
+      out << "\nPrinting IndexIntoFile contents.  This includes a list of all Runs, LuminosityBlocks\n"
+         << "and Events stored in the root file.\n\n";
+      out << std::setw(15) << "Run"
+         << std::setw(15) << "Lumi"
+         << std::setw(15) << "Event"
+         << std::setw(15) << "TTree Entry"
+         << "\n";
+      for(std::vector<EventTableRow>::const_iterator it = table.rows.begin(), itEnd = table.rows.end(); it != itEnd; ++it) {
+        char const* type = it->type == EventTableRow::kRun ? "(Run)" : (it->type == EventTableRow::kLumi ? "(Lumi)" : "");
+        out << std::setw(15) << it->run << std::setw(15) << it->lumi;
+        out << std::setw(15) << it->event << std::setw(15) << it->entry << " " << type << std::endl;
       }
-      std::cout << std::setw(15) << eventNum << std::setw(15) << it.entry() << " " << type << std::endl;
     }
+    printFastCopyInfo(out, format, fileName, table);
+  }
 
-    std::cout << "\nFileFormatVersion = " << fileFormatVersion << ".  ";
-    if (fileFormatVersion.fastCopyPossible()) std::cout << "This version supports fast copy\n";
-    else std::cout << "This version does not support fast copy\n";
-
-    if (indexIntoFile.iterationWillBeInEntryOrder(IndexIntoFile::firstAppearanceOrder)) {
-      std::cout << "Events are sorted such that fast copy is possible in the \"noEventSort = false\" mode\n";
-    } else {
-      std::cout << "Events are sorted such that fast copy is NOT possible in the \"noEventSort = false\" mode\n";
+  void printEventsInLumis(TFile *tfl, ReportFormat format, std::string const& fileName, std::ostream& out) {
+    std::vector<LumiEventCount> counts;
+    EventTable::Problem problem;
+    if (!readEventsInLumis(tfl, counts, problem)) {
+      printEventTableProblem(out, format, fileName, problem);
+      return;
     }
-
-    // This will not work unless the other nonpersistent parts of the Index are filled first
-    // I did not have time to implement this yet.
-    // if (indexIntoFile.iterationWillBeInEntryOrder(IndexIntoFile::numericalOrder)) {
-    //   std::cout << "Events are sorted such that fast copy is possible in the \"noEventSort\" mode\n";
-    // } else {
-    //   std::cout << "Events are sorted such that fast copy is NOT possible in the \"noEventSort\" mode\n";
-    // }
-    std::cout << "(Note that other factors can prevent fast copy from occurring)\n\n";
+    if (format == kTextReport) {
+      out <<"\n"<< std::setw(15) << "Run"
+      << std::setw(15) << "Lumi"
+      << std::setw(15) << "# Events"
+      << "\n";
+    }
+    for(std::vector<LumiEventCount>::const_iterator it = counts.begin(), itEnd = counts.end(); it != itEnd; ++it) {
+      printLumiCount(out, format, fileName, it->run, it->lumi, it->events);
+    }
+    if (format == kTextReport) out << "\n";
   }
 
-  void printEventLists(TFile *tfl) {
+  bool readFileMergeInfo(TFile* tfl, FileMergeInfo& info) {
+    info = FileMergeInfo();
+    std::vector<LumiEventCount> lumis;
+    if (!readEventsInLumis(tfl, lumis)) return false;
     TTree *metaDataTree = dynamic_cast<TTree *>(tfl->Get(poolNames::metaDataTreeName().c_str()));
-    assert(0 != metaDataTree);
+    TTree *eventsTree = dynamic_cast<TTree *>(tfl->Get(poolNames::eventTreeName().c_str()));
+    if (metaDataTree == 0 || eventsTree == 0) return false;
+
+    info.bytes = tfl->GetSize();
+    info.events = eventsTree->GetEntries();
+    for (std::vector<LumiEventCount>::const_iterator it = lumis.begin(), itEnd = lumis.end(); it != itEnd; ++it) {
+      bool first = it == lumis.begin();
+      if (first || it->run < info.firstRun || (it->run == info.firstRun && it->lumi < info.firstLumi)) {
+        info.firstRun = it->run;
+        info.firstLumi = it->lumi;
+      }
+      if (first || it->run > info.lastRun || (it->run == info.lastRun && it->lumi > info.lastLumi)) {
+        info.lastRun = it->run;
+        info.lastLumi = it->lumi;
+      }
+    }
 
     FileFormatVersion fileFormatVersion;
     FileFormatVersion *fftPtr = &fileFormatVersion;
@@ -237,135 +469,187 @@ namespace edm {
       fft->SetAddress(&fftPtr);
       fft->GetEntry(0);
     }
-    if(fileFormatVersion.hasIndexIntoFile()) {
-      postIndexIntoFilePrintEventLists(tfl, fileFormatVersion, metaDataTree);
+    info.fileFormatVersion = fileFormatVersion.value();
+    info.fastCopyPossible = fileFormatVersion.fastCopyPossible();
+    if (fileFormatVersion.hasIndexIntoFile()) {
+      IndexIntoFile indexIntoFile;
+      IndexIntoFile *findexPtr = &indexIntoFile;
+      TBranch *fndx = metaDataTree->GetBranch(poolNames::indexIntoFileBranchName().c_str());
+      fndx->SetAddress(&findexPtr);
+      fndx->GetEntry(0);
+      info.entryOrder = indexIntoFile.iterationWillBeInEntryOrder(IndexIntoFile::firstAppearanceOrder);
     } else {
-      preIndexIntoFilePrintEventLists(tfl, fileFormatVersion, metaDataTree);
-    }
-  }
-
-  static void preIndexIntoFilePrintEventsInLumis(TFile*, FileFormatVersion const& fileFormatVersion, TTree *metaDataTree) {
-    FileIndex fileIndex;
-    FileIndex *findexPtr = &fileIndex;
-    if (metaDataTree->FindBranch(poolNames::fileIndexBranchName().c_str()) != 0) {
+      FileIndex fileIndex;
+      FileIndex *findexPtr = &fileIndex;
       TBranch *fndx = metaDataTree->GetBranch(poolNames::fileIndexBranchName().c_str());
       fndx->SetAddress(&findexPtr);
       fndx->GetEntry(0);
-    } else {
-      std::cout << "FileIndex not found.  If this input file was created with release 1_8_0 or later\n"
-      "this indicates a problem with the file.  This condition should be expected with\n"
-      "files created with earlier releases and printout of the event list will fail.\n";
-      return;
+      info.entryOrder = fileIndex.allEventsInEntryOrder();
     }
 
-    std::cout <<"\n"<< std::setw(15) << "Run"
-    << std::setw(15) << "Lumi"
-    << std::setw(15) << "# Events"
-    << "\n";
-    unsigned long nEvents = 0;
-    unsigned long runID = 0;
-    unsigned long lumiID = 0;
-    for(std::vector<FileIndex::Element>::const_iterator it = fileIndex.begin(), itEnd = fileIndex.end(); it != itEnd; ++it) {
-      if(it->getEntryType() == FileIndex::kEvent) {
-        ++nEvents;
-      }
-      else if(it->getEntryType() == FileIndex::kLumi) {
-        if(runID !=it->run_ || lumiID !=it->lumi_) {
-          //print the previous one
-          if(lumiID !=0) {
-            std::cout << std::setw(15) << runID
-            << std::setw(15) << lumiID
-            << std::setw(15) << nEvents<<"\n";
-          }
-          nEvents=0;
-          runID = it->run_;
-          lumiID = it->lumi_;
-        }
+    Long64_t nB = eventsTree->GetListOfBranches()->GetEntries();
+    for (Long64_t i = 0; i < nB; ++i) {
+      TBranch *branch = (TBranch *)eventsTree->GetListOfBranches()->At(i);
+      BranchSetting setting;
+      setting.name = branch->GetName();
+      setting.compression = branch->GetCompressionSettings();
+      setting.basketSize = branch->GetBasketSize();
+      info.branches.push_back(setting);
+    }
+    std::sort(info.branches.begin(), info.branches.end(),
+              [](BranchSetting const& a, BranchSetting const& b) { return a.name < b.name; });
+
+    ProcessHistoryVector histories;
+    if (metaDataTree->FindBranch(poolNames::processHistoryBranchName().c_str()) != 0) {
+      ProcessHistoryVector *phvPtr = &histories;
+      TBranch *phv = metaDataTree->GetBranch(poolNames::processHistoryBranchName().c_str());
+      phv->SetAddress(&phvPtr);
+      phv->GetEntry(0);
+    } else if (metaDataTree->FindBranch(poolNames::processHistoryMapBranchName().c_str()) != 0) {
+      ProcessHistoryMap historyMap;
+      ProcessHistoryMap *phmPtr = &historyMap;
+      TBranch *phm = metaDataTree->GetBranch(poolNames::processHistoryMapBranchName().c_str());
+      phm->SetAddress(&phmPtr);
+      phm->GetEntry(0);
+      for (ProcessHistoryMap::const_iterator it = historyMap.begin(), itEnd = historyMap.end(); it != itEnd; ++it) {
+        histories.push_back(it->second);
       }
     }
-    //print the last one
-    if(lumiID !=0) {
-      std::cout << std::setw(15) << runID
-      << std::setw(15) << lumiID
-      << std::setw(15) << nEvents<<"\n";
+    for (ProcessHistoryVector::const_iterator it = histories.begin(), itEnd = histories.end(); it != itEnd; ++it) {
+      std::string names;
+      for (ProcessHistory::const_iterator pc = it->begin(), pcEnd = it->end(); pc != pcEnd; ++pc) {
+        if (!names.empty()) names += ',';
+        names += pc->processName();
+      }
+      info.processHistories.push_back(names);
     }
-
-    std::cout << "\n";
+    std::sort(info.processHistories.begin(), info.processHistories.end());
+    info.processHistories.erase(std::unique(info.processHistories.begin(), info.processHistories.end()), info.processHistories.end());
+    return true;
   }
 
-  static void postIndexIntoFilePrintEventsInLumis(TFile* tfl, FileFormatVersion const& fileFormatVersion, TTree *metaDataTree) {
-    IndexIntoFile indexIntoFile;
-    IndexIntoFile *findexPtr = &indexIntoFile;
-    if (metaDataTree->FindBranch(poolNames::indexIntoFileBranchName().c_str()) != 0) {
-      TBranch *fndx = metaDataTree->GetBranch(poolNames::indexIntoFileBranchName().c_str());
-      fndx->SetAddress(&findexPtr);
-      fndx->GetEntry(0);
-    } else {
-      std::cout << "IndexIntoFile not found.  If this input file was created with release 1_8_0 or later\n"
-      "this indicates a problem with the file.  This condition should be expected with\n"
-      "files created with earlier releases and printout of the event list will fail.\n";
-      return;
+  namespace {
+    void addLeafBranches(TBranch *branch, std::vector<TBranch*>& branches) {
+      branches.push_back(branch);
+      TObjArray* subBranches = branch->GetListOfBranches();
+      for (Int_t i = 0, n = subBranches->GetEntriesFast(); i < n; ++i) {
+        addLeafBranches(static_cast<TBranch*>(subBranches->UncheckedAt(i)), branches);
+      }
     }
-    std::cout <<"\n"<< std::setw(15) << "Run"
-    << std::setw(15) << "Lumi"
-    << std::setw(15) << "# Events"
-    << "\n";
-
-    unsigned long nEvents = 0;
-    unsigned long runID = 0;
-    unsigned long lumiID = 0;
-
-    for(IndexIntoFile::IndexIntoFileItr it = indexIntoFile.begin(IndexIntoFile::firstAppearanceOrder),
-        itEnd = indexIntoFile.end(IndexIntoFile::firstAppearanceOrder);
-        it != itEnd; ++it) {
-      IndexIntoFile::EntryType t = it.getEntryType();
-      switch(t) {
-        case IndexIntoFile::kRun:
-          break;
-        case IndexIntoFile::kLumi:
-          if(runID != it.run() || lumiID != it.lumi()) {
-            //print the previous one
-            if(lumiID !=0) {
-              std::cout << std::setw(15) << runID
-              << std::setw(15) << lumiID
-              << std::setw(15) << nEvents<<"\n";
-            }
-            nEvents=0;
-            runID = it.run();
-            lumiID = it.lumi();
-          }
-          break;
-        case IndexIntoFile::kEvent:
-          ++nEvents;
-          break;
-        default:
-          break;
+
+    // Every tree of 'tfl', by name, and all of its branches, in the same
+    // order whichever TFile of the same file they come from.
+    void listBranches(TFile *tfl, std::vector<std::pair<std::string, std::vector<TBranch*> > >& trees) {
+      TIter next(tfl->GetListOfKeys());
+      std::string lastName;
+      while (TKey *key = static_cast<TKey*>(next())) {
+        if (std::string(key->GetClassName()) != "TTree" || lastName == key->GetName()) continue;
+        lastName = key->GetName(); // Only the highest cycle.
+        TTree *tree = dynamic_cast<TTree*>(tfl->Get(key->GetName()));
+        if (tree == 0) continue;
+        trees.push_back(std::make_pair(lastName, std::vector<TBranch*>()));
+        TObjArray* branches = tree->GetListOfBranches();
+        for (Int_t i = 0, n = branches->GetEntriesFast(); i < n; ++i) {
+          addLeafBranches(static_cast<TBranch*>(branches->UncheckedAt(i)), trees.back().second);
+        }
       }
     }
-    //print the last one
-    if(lumiID !=0) {
-      std::cout << std::setw(15) << runID
-      << std::setw(15) << lumiID
-      << std::setw(15) << nEvents<<"\n";
+
+    void checkBranchBaskets(std::string const& treeName, TBranch *branch, std::vector<BadBasket>& bad, Long64_t& nBaskets) {
+      Int_t const n = branch->GetWriteBasket();
+      Int_t* const basketBytes = branch->GetBasketBytes();
+      Long64_t* const basketEntry = branch->GetBasketEntry();
+      Long64_t* const basketSeek = branch->GetBasketSeek();
+      for (Int_t i = 0; i < n; ++i) {
+        ++nBaskets;
+        Long64_t const first = basketEntry[i];
+        Long64_t const last = (i + 1 < n ? basketEntry[i + 1] : branch->GetEntries()) - 1;
+        std::string reason;
+        if (basketSeek[i] == 0) {
+          reason = "no file offset recorded";
+        } else {
+          TBasket *basket = branch->GetBasket(i);
+          if (basket == 0) {
+            reason = "could not be read or decompressed";
+          } else if (basket->GetNbytes() != basketBytes[i]) {
+            std::ostringstream s;
+            s << "header says " << basket->GetNbytes() << " bytes, branch says " << basketBytes[i];
+            reason = s.str();
+          } else if (basket->GetNevBuf() != last - first + 1) {
+            std::ostringstream s;
+            s << "holds " << basket->GetNevBuf() << " entries, branch says " << last - first + 1;
+            reason = s.str();
+          }
+        }
+        if (!reason.empty()) {
+          BadBasket b;
+          b.tree = treeName;
+          b.branch = branch->GetName();
+          b.basket = i;
+          b.firstEntry = first;
+          b.lastEntry = last;
+          b.seek = basketSeek[i];
+          b.reason = reason;
+          bad.push_back(b);
+        }
+        // Keep at most one basket of the branch in memory.
+        branch->DropBaskets("all");
+      }
     }
-    std::cout << "\n";
   }
 
-  void printEventsInLumis(TFile *tfl) {
-    TTree *metaDataTree = dynamic_cast<TTree *>(tfl->Get(poolNames::metaDataTreeName().c_str()));
-    assert(0 != metaDataTree);
-
-    FileFormatVersion fileFormatVersion;
-    FileFormatVersion *fftPtr = &fileFormatVersion;
-    if (metaDataTree->FindBranch(poolNames::fileFormatVersionBranchName().c_str()) != 0) {
-      TBranch *fft = metaDataTree->GetBranch(poolNames::fileFormatVersionBranchName().c_str());
-      fft->SetAddress(&fftPtr);
-      fft->GetEntry(0);
-    }
-    if(fileFormatVersion.hasIndexIntoFile()) {
-      postIndexIntoFilePrintEventsInLumis(tfl, fileFormatVersion, metaDataTree);
-    } else {
-      preIndexIntoFilePrintEventsInLumis(tfl, fileFormatVersion, metaDataTree);
+  bool verifyBaskets(std::string const& pfn, unsigned int nThreads, std::vector<BadBasket>& bad, Long64_t& nBaskets) {
+    bad.clear();
+    nBaskets = 0;
+    std::unique_ptr<TFile> tfl(TFile::Open(pfn.c_str(), "read"));
+    if (!tfl) return false;
+    std::vector<std::pair<std::string, std::vector<TBranch*> > > trees;
+    listBranches(tfl.get(), trees);
+    unsigned int nBranches = 0;
+    for (unsigned int t = 0; t < trees.size(); ++t) nBranches += trees[t].second.size();
+    if (nThreads > nBranches) nThreads = nBranches;
+    if (nThreads == 0) nThreads = 1;
+
+    // Thread 0 uses the file already open; the others open their own.
+    std::vector<std::vector<BadBasket> > badPerThread(nThreads);
+    std::vector<Long64_t> basketsPerThread(nThreads, 0);
+    std::vector<std::string> errors(nThreads);
+    parallelFor(nThreads, nThreads, [&](unsigned int thread) {
+      std::unique_ptr<TFile> own;
+      std::vector<std::pair<std::string, std::vector<TBranch*> > > ownTrees;
+      std::vector<std::pair<std::string, std::vector<TBranch*> > > const* myTrees = &trees;
+      if (thread != 0) {
+        own.reset(TFile::Open(pfn.c_str(), "read"));
+        if (!own) {
+          errors[thread] = "could not open the file again";
+          return;
+        }
+        listBranches(own.get(), ownTrees);
+        myTrees = &ownTrees;
+      }
+      unsigned int index = 0;
+      for (unsigned int t = 0; t < myTrees->size(); ++t) {
+        std::vector<TBranch*> const& branches = (*myTrees)[t].second;
+        for (unsigned int b = 0; b < branches.size(); ++b, ++index) {
+          if (index % nThreads != thread) continue;
+          checkBranchBaskets((*myTrees)[t].first, branches[b], badPerThread[thread], basketsPerThread[thread]);
+        }
+      }
+      if (own) own->Close();
+    });
+    for (unsigned int thread = 0; thread < nThreads; ++thread) {
+      if (!errors[thread].empty()) {
+        BadBasket b;
+        b.basket = -1;
+        b.firstEntry = b.lastEntry = b.seek = -1;
+        b.reason = errors[thread];
+        bad.push_back(b);
+      }
+      bad.insert(bad.end(), badPerThread[thread].begin(), badPerThread[thread].end());
+      nBaskets += basketsPerThread[thread];
     }
+    std::stable_sort(bad.begin(), bad.end(), [](BadBasket const& a, BadBasket const& b) { return a.seek < b.seek; });
+    tfl->Close();
+    return true;
   }
 }
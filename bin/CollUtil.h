@@ -1,24 +1,98 @@
 #ifndef Modules_CollUtil_h
 #define Modules_CollUtil_h
 
+#include "IOPool/Common/interface/FileContents.h"
+
+#include "DataFormats/Provenance/interface/EventID.h"
 #include "Rtypes.h"
 
+#include <iostream>
 #include <string>
+#include <vector>
 
 class TFile;
 class TTree;
 
 namespace edm {
-  
+
+  // How the print functions below, which format what the readers in
+  // FileContents.h return, write to 'out' (std::cout unless given; the text
+  // form of longBranchPrint always goes to stdout, through TBranch::Print).
+  // kNDJSONReport writes one JSON object per line, so the output can be
+  // consumed while it is produced.  Every object has a "record" member
+  // giving its kind and a "file" member naming the file.
+  enum ReportFormat { kTextReport, kNDJSONReport };
+
+  // 's' with the characters JSON does not allow in strings escaped.
+  std::string jsonEscape(std::string const& s);
+
   TFile* openFileHdl(const std::string& fname) ;
+  TFile* openFileHdl(const std::string& fname, std::ostream& err);
+  // TDirectory::ls and TTree::Print of every tree, on stdout.  ROOT does
+  // the formatting, so unlike the printers below there is no reader.
   void printTrees(TFile *hdl);
   Long64_t numEntries(TFile *hdl, const std::string& trname);
-  void printBranchNames(TTree *tree);
-  void longBranchPrint(TTree *tr);
-  std::string getUuid(TTree *uuidTree);
+  // As above, but reports a missing tree to 'err' rather than std::cout.
+  Long64_t numEntries(TFile *hdl, const std::string& trname, std::ostream& err);
+  // As numEntries, but read from the key directory and the start of the
+  // tree's record without building the tree (see TreeEntryCount.h).
+  // Falls back to numEntries for records it cannot decode.
+  Long64_t numEntriesFromKey(TFile *hdl, const std::string& trname);
+  Long64_t numEntriesFromKey(TFile *hdl, const std::string& trname, std::ostream& err);
+  void printBranchNames(TTree *tree, ReportFormat format = kTextReport, std::string const& fileName = std::string(), std::ostream& out = std::cout);
+  void longBranchPrint(TTree *tr, ReportFormat format = kTextReport, std::string const& fileName = std::string(), std::ostream& out = std::cout);
+  // The columns printBranchStats can sort by.  Returns false for any other name.
+  bool isBranchStatsColumn(std::string const& column);
+  // Storage statistics for each top level branch of 'tree', including all
+  // of its sub-branches: compressed and uncompressed bytes, compression
+  // ratio, number of baskets, min/median/max compressed basket size,
+  // entries per basket and the fraction of the file taken.  Rows are sorted
+  // by 'sortBy', numeric columns largest first and "branch" alphabetically.
+  void printBranchStats(TTree *tree, std::string const& sortBy, ReportFormat format = kTextReport, std::string const& fileName = std::string(), std::ostream& out = std::cout);
   void printUuids(TTree *uuidTree);
-  void printEventLists(TFile *tfl);
-  void printEventsInLumis(TFile* tfl);
+  void printEventLists(TFile *tfl, ReportFormat format = kTextReport, std::string const& fileName = std::string(), std::ostream& out = std::cout);
+  // The storage settings of one top level branch.
+  struct BranchSetting {
+    std::string name;
+    int compression;
+    int basketSize;
+  };
+  // What decides whether a file can be fast cloned into a merged output.
+  struct FileMergeInfo {
+    FileMergeInfo() : fileFormatVersion(0), fastCopyPossible(false), entryOrder(false), events(0), bytes(0),
+                      firstRun(0), firstLumi(0), lastRun(0), lastLumi(0), branches(), processHistories() {}
+    int fileFormatVersion;
+    bool fastCopyPossible;   // by the file format version
+    bool entryOrder;         // events are stored in the order they will be read
+    Long64_t events;
+    Long64_t bytes;
+    RunNumber_t firstRun;    // the smallest and largest run:lumi in the file
+    LuminosityBlockNumber_t firstLumi;
+    RunNumber_t lastRun;
+    LuminosityBlockNumber_t lastLumi;
+    std::vector<BranchSetting> branches;        // of the Events tree, sorted by name
+    std::vector<std::string> processHistories;  // process names joined by ',', sorted
+  };
+  // Fill 'info' for 'tfl'.  Returns false if the file has no metadata or index.
+  bool readFileMergeInfo(TFile* tfl, FileMergeInfo& info);
+  // A basket which could not be read, or whose contents disagree with
+  // what the branch expects.
+  struct BadBasket {
+    std::string tree;
+    std::string branch;
+    int basket;
+    Long64_t firstEntry;
+    Long64_t lastEntry;
+    Long64_t seek;      // file offset
+    std::string reason;
+  };
+  // Read and decompress every basket of every branch of every tree in
+  // 'pfn', without streaming any object, and check each against the sizes
+  // recorded in the branch.  The branches are shared out among 'nThreads'
+  // threads, each with its own TFile.  Returns false if the file could not
+  // be opened at all.
+  bool verifyBaskets(std::string const& pfn, unsigned int nThreads, std::vector<BadBasket>& bad, Long64_t& nBaskets);
+  void printEventsInLumis(TFile* tfl, ReportFormat format = kTextReport, std::string const& fileName = std::string(), std::ostream& out = std::cout);
 }
 
 #endif
@@ -0,0 +1,137 @@
+#include "IOPool/Common/bin/DuplicateFinder.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace edm {
+
+  namespace {
+    unsigned int const kShards = 256;
+
+    unsigned int shardOf(EventIndexRecord const& r) {
+      // A multiplicative hash of the key; the top bits pick the shard.
+      uint64_t h = (uint64_t(r.run) << 32 | r.lumi) * 0x9E3779B97F4A7C15ULL;
+      h ^= r.event * 0xC2B2AE3D27D4EB4FULL;
+      h ^= h >> 29;
+      return (h * 0x165667B19E3779F9ULL) >> 56;
+    }
+
+    bool sameEvent(EventIndexRecord const& a, EventIndexRecord const& b) {
+      return a.run == b.run && a.lumi == b.lumi && a.event == b.event;
+    }
+  }
+
+  DuplicateFinder::DuplicateFinder(size_t memoryBudget, std::string const& spillDirectory) :
+    maxInMemory_(std::max<size_t>(memoryBudget / sizeof(EventIndexRecord), kShards)),
+    spillDirectory_(spillDirectory),
+    shards_(kShards),
+    spillFds_(kShards, -1),
+    spilled_(kShards, 0),
+    inMemory_(0),
+    nAdded_(0),
+    spilledBytes_(0) {
+  }
+
+  DuplicateFinder::~DuplicateFinder() {
+    for(std::vector<int>::const_iterator it = spillFds_.begin(), itEnd = spillFds_.end(); it != itEnd; ++it) {
+      if(*it >= 0) close(*it);
+    }
+  }
+
+  void DuplicateFinder::add(EventIndexRecord const& location) {
+    shards_[shardOf(location)].push_back(location);
+    ++inMemory_;
+    ++nAdded_;
+    while(inMemory_ > maxInMemory_) {
+      spillLargest();
+    }
+  }
+
+  void DuplicateFinder::spillLargest() {
+    unsigned int largest = 0;
+    for(unsigned int i = 1; i < kShards; ++i) {
+      if(shards_[i].size() > shards_[largest].size()) largest = i;
+    }
+    std::vector<EventIndexRecord>& shard = shards_[largest];
+    int& fd = spillFds_[largest];
+    if(fd < 0) {
+      std::string name = spillDirectory_ + "/edmFileUtilDuplicatesXXXXXX";
+      std::vector<char> buffer(name.begin(), name.end());
+      buffer.push_back('\0');
+      fd = mkstemp(&buffer[0]);
+      if(fd < 0) {
+        throw cms::Exception("FileOpenError", "DuplicateFinder")
+          << "Could not create a spill file in " << spillDirectory_ << ": " << strerror(errno) << "\n";
+      }
+      unlink(&buffer[0]);
+    }
+    char const* p = reinterpret_cast<char const*>(&shard[0]);
+    size_t size = shard.size() * sizeof(EventIndexRecord);
+    while(size > 0) {
+      ssize_t n = write(fd, p, size);
+      if(n < 0 && errno == EINTR) continue;
+      if(n <= 0) {
+        throw cms::Exception("FileWriteError", "DuplicateFinder")
+          << "Could not write a spill file in " << spillDirectory_ << ": " << strerror(errno) << "\n";
+      }
+      p += n;
+      size -= n;
+    }
+    spilled_[largest] += shard.size();
+    spilledBytes_ += shard.size() * sizeof(EventIndexRecord);
+    inMemory_ -= shard.size();
+    std::vector<EventIndexRecord>().swap(shard);
+  }
+
+  unsigned long long DuplicateFinder::findDuplicates(Reporter const& report) {
+    unsigned long long nDuplicates = 0;
+    std::vector<EventIndexRecord> records;
+    for(unsigned int i = 0; i < kShards; ++i) {
+      records.clear();
+      records.reserve(spilled_[i] + shards_[i].size());
+      if(spilled_[i] != 0) {
+        records.resize(spilled_[i]);
+        char* p = reinterpret_cast<char*>(&records[0]);
+        size_t size = spilled_[i] * sizeof(EventIndexRecord);
+        off_t offset = 0;
+        while(size > 0) {
+          ssize_t n = pread(spillFds_[i], p, size, offset);
+          if(n < 0 && errno == EINTR) continue;
+          if(n <= 0) {
+            throw cms::Exception("FileReadError", "DuplicateFinder")
+              << "Could not read back a spill file: " << strerror(errno) << "\n";
+          }
+          p += n;
+          size -= n;
+          offset += n;
+        }
+      }
+      spilled_[i] = 0;
+      if(spillFds_[i] >= 0) {
+        close(spillFds_[i]);
+        spillFds_[i] = -1;
+      }
+      records.insert(records.end(), shards_[i].begin(), shards_[i].end());
+      std::vector<EventIndexRecord>().swap(shards_[i]);
+
+      std::sort(records.begin(), records.end());
+      std::vector<EventIndexRecord>::const_iterator it = records.begin();
+      while(it != records.end()) {
+        std::vector<EventIndexRecord>::const_iterator itEnd = it + 1;
+        while(itEnd != records.end() && sameEvent(*it, *itEnd)) ++itEnd;
+        if(itEnd - it > 1) {
+          ++nDuplicates;
+          report(&*it, &*it + (itEnd - it));
+        }
+        it = itEnd;
+      }
+    }
+    return nDuplicates;
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef IOPool_Common_DuplicateFinder_h
+#define IOPool_Common_DuplicateFinder_h
+
+// Finds run:lumi:event keys occurring more than once among a very large
+// number of event locations, in bounded memory.
+//
+// Locations are hashed on their key into a fixed number of shards, so
+// all copies of a key land in the same shard.  While the locations held
+// in memory exceed the budget, the largest shard buffers are appended to
+// per-shard spill files.  At the end each shard is loaded on its own,
+// sorted and scanned, so only one shard needs to fit in memory at a time.
+
+#include "IOPool/Common/bin/EventIndexFile.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace edm {
+
+  class DuplicateFinder {
+  public:
+    // Called with all the locations of one duplicated key, sorted by file
+    // and entry.
+    typedef std::function<void (EventIndexRecord const* begin, EventIndexRecord const* end)> Reporter;
+
+    // 'memoryBudget' is in bytes.  Spill files are created, already
+    // unlinked, in 'spillDirectory'.
+    DuplicateFinder(size_t memoryBudget, std::string const& spillDirectory);
+    ~DuplicateFinder();
+
+    DuplicateFinder(DuplicateFinder const&) = delete;
+    DuplicateFinder& operator=(DuplicateFinder const&) = delete;
+
+    // Not thread safe.  Throws if a spill file cannot be written.
+    void add(EventIndexRecord const& location);
+
+    // Calls 'report' for every duplicated key, shard by shard; keys are in
+    // increasing order within a shard.  Returns the number of duplicated
+    // keys.  Throws if a spill file cannot be read back.
+    unsigned long long findDuplicates(Reporter const& report);
+
+    unsigned long long size() const { return nAdded_; }
+    unsigned long long spilledBytes() const { return spilledBytes_; }
+
+  private:
+    void spillLargest();
+
+    size_t maxInMemory_;
+    std::string spillDirectory_;
+    std::vector<std::vector<EventIndexRecord> > shards_;
+    std::vector<int> spillFds_;       // -1 until the shard first spills
+    std::vector<unsigned long long> spilled_; // records spilled per shard
+    size_t inMemory_;
+    unsigned long long nAdded_;
+    unsigned long long spilledBytes_;
+  };
+}
+
+#endif
@@ -3,28 +3,1337 @@
 //
 
 #include <algorithm>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <exception>
 #include <iostream>
+#include <memory>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
+#include <stdint.h>
+#include <time.h>
 #include <boost/program_options.hpp>
+#include "IOPool/Common/bin/ChecksumUtil.h"
 #include "IOPool/Common/bin/CollUtil.h"
+#include "IOPool/Common/bin/DuplicateFinder.h"
+#include "IOPool/Common/bin/EventIndexFile.h"
+#include "IOPool/Common/bin/FileMetadataCache.h"
+#include "IOPool/Common/bin/LfnResolver.h"
+#include "IOPool/Common/bin/MergePlan.h"
+#include "IOPool/Common/bin/ParallelFor.h"
+#include "IOPool/Common/bin/QueryServer.h"
+#include "IOPool/Common/interface/TreeEntryCount.h"
 #include "DataFormats/Provenance/interface/BranchType.h"
-#include "FWCore/Catalog/interface/InputFileCatalog.h"
 #include "FWCore/Catalog/interface/SiteLocalConfig.h"
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
 #include "FWCore/PluginManager/interface/PluginManager.h"
 #include "FWCore/PluginManager/interface/standard.h"
 #include "FWCore/RootAutoLibraryLoader/interface/RootAutoLibraryLoader.h"
 #include "FWCore/Services/src/SiteLocalConfigService.h"
-#include "FWCore/Utilities/interface/Adler32Calculator.h"
 #include "FWCore/Utilities/interface/Exception.h"
 #include "FWCore/ServiceRegistry/interface/ServiceRegistry.h"
 
+#include "Cintex/Cintex.h"
 #include "TFile.h"
 #include "TError.h"
+#include "TThread.h"
+
+namespace {
+
+  struct FileUtilOptions {
+    std::vector<std::string> expectedTrees;
+    std::string selectedTree;
+    unsigned int checksumBuffers;
+    unsigned int checksumThreads;
+    bool localRead;
+    edm::LocalReadMode localReadMode;
+    bool checksumOnly;
+    size_t checksumBufferSize;
+    bool decodeLFN;
+    bool uuid;
+    edm::DigestSelection digests;
+    bool allowRecovery;
+    bool fastOpen;     // Trees and entry counts from the key directory, without building the trees.
+    bool timing;       // Print where the time for each file went.
+    bool json;
+    bool ndjson;       // One JSON record per line, including the detailed reports.
+    bool verbose;
+    bool events;
+    bool eventsInLumis;
+    bool ls;
+    bool print;
+    bool printBranchDetails;
+    bool branchStats;
+    bool dataset;
+    std::string branchStatsSortBy;
+    edm::FileMetadataCache* cache; // 0 if no cache is used
+  };
+
+  // Wall and CPU time spent in one phase of the work on a file.  The CPU
+  // time is that of the thread which did the work.
+  struct PhaseTime {
+    PhaseTime() : wall(0.), cpu(0.) {}
+    double wall;
+    double cpu;
+  };
+
+  double threadCpuSeconds() {
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0.;
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+  }
+
+  // Adds the time from its construction to its destruction to 'phase'.
+  class PhaseTimer {
+  public:
+    explicit PhaseTimer(PhaseTime& phase) :
+      phase_(phase), wallStart_(std::chrono::steady_clock::now()), cpuStart_(threadCpuSeconds()) {}
+    ~PhaseTimer() {
+      phase_.wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart_).count();
+      phase_.cpu += threadCpuSeconds() - cpuStart_;
+    }
+  private:
+    PhaseTime& phase_;
+    std::chrono::steady_clock::time_point wallStart_;
+    double cpuStart_;
+  };
+
+  // Where the time for one file went, and what ROOT read for it (--timing).
+  struct FileTiming {
+    FileTiming() : open(), trees(), checksum(), details(), checksumBytes(0), bytesRead(-1), readCalls(-1) {}
+    double checksumMBps() const {
+      return checksum.wall > 0. ? checksumBytes / checksum.wall / (1024. * 1024.) : 0.;
+    }
+    PhaseTime open;     // TFile::Open
+    PhaseTime trees;    // the expected tree check, uuid and entry counts
+    PhaseTime checksum;
+    PhaseTime details;  // the detailed reports (-e, -P, ...)
+    long long checksumBytes;
+    long long bytesRead; // by the file's TFile, -1 if the file was not opened as a whole
+    int readCalls;
+  };
+
+  // 'timing' as JSON members (without the enclosing braces), or as one
+  // indented line of text.
+  void printTiming(FileTiming const& timing, bool json, std::ostream& out) {
+    struct { char const* name; PhaseTime const* phase; } const phases[] = {
+      {"open", &timing.open}, {"trees", &timing.trees}, {"checksum", &timing.checksum}, {"details", &timing.details}
+    };
+    std::ios_base::fmtflags const flags = out.flags();
+    std::streamsize const precision = out.precision();
+    out << std::fixed << std::setprecision(6);
+    if (json) {
+      for (unsigned int i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i) {
+        out << (i == 0 ? "" : ",") << '"' << phases[i].name << "\":{\"wall\":" << phases[i].phase->wall
+            << ",\"cpu\":" << phases[i].phase->cpu;
+        if (phases[i].phase == &timing.checksum) {
+          out << ",\"bytes\":" << timing.checksumBytes << ",\"MBps\":" << timing.checksumMBps();
+        }
+        out << '}';
+      }
+      if (timing.bytesRead >= 0) {
+        out << ",\"bytesRead\":" << timing.bytesRead << ",\"readCalls\":" << timing.readCalls;
+      }
+    } else {
+      out << "  timing (wall/cpu s):";
+      for (unsigned int i = 0; i < sizeof(phases) / sizeof(phases[0]); ++i) {
+        out << (i == 0 ? " " : ", ") << phases[i].name << ' ' << phases[i].phase->wall << '/' << phases[i].phase->cpu;
+        if (phases[i].phase == &timing.checksum && timing.checksumBytes > 0) {
+          out << " (" << std::setprecision(1) << timing.checksumMBps() << " MB/s)" << std::setprecision(6);
+        }
+      }
+      if (timing.bytesRead >= 0) {
+        out << "; " << timing.bytesRead << " bytes read in " << timing.readCalls << " calls";
+      }
+      out << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+  }
+
+  // Everything learned about one input file by summarizeFile().
+  struct FileReport {
+    FileReport() : tfile(0), rc(0), text(), error(), timing(), recordOpen(false) {}
+    TFile* tfile;      // Left open on success if there are detailed reports.
+    int rc;            // 0 on success.
+    std::string text;  // Output for this file, in the order it was produced.
+    std::string error; // Why the file was rejected, if it was, or warnings.
+    FileTiming timing;
+    bool recordOpen;   // The -j record in 'text' still needs its timing and closing brace.
+  };
+
+  // With -j and --timing the file record is left open until everything
+  // has been read from the file, so that its "timing" member holds the
+  // same numbers as the text and NDJSON timing reports.
+  bool timingInRecord(FileUtilOptions const& opt) {
+    return opt.timing && opt.json && !opt.ndjson;
+  }
+
+  void closeRecord(FileReport& report, std::ostream& out) {
+    if (!report.recordOpen) return;
+    out << ",\"timing\":{";
+    printTiming(report.timing, true, out);
+    out << "}}" << std::endl;
+    report.recordOpen = false;
+  }
+
+  // The selected digests of 'pfn', computed in one pass over the file.
+  // Local files are read directly when --localRead was given.  Otherwise
+  // 'tfile' is used if it is not null, or the file is opened raw, without
+  // parsing it as a ROOT file.
+  edm::DigestValues computeDigests(FileUtilOptions const& opt, std::string const& pfn, TFile* tfile) {
+    std::string path;
+    if (opt.localRead && edm::localFilePath(pfn, path)) {
+      return edm::localFileDigests(path, opt.localReadMode, opt.digests, opt.checksumThreads,
+                                   opt.checksumBuffers, opt.checksumBufferSize);
+    }
+    std::unique_ptr<TFile> rawFile;
+    if (tfile == 0) {
+      std::string rawName = pfn + (pfn.find('?') == std::string::npos ? "?filetype=raw" : "&filetype=raw");
+      rawFile.reset(TFile::Open(rawName.c_str(), "read"));
+      if (!rawFile) {
+        throw cms::Exception("FileOpenError", "computeDigests")
+          << "ERR Could not open file " << pfn << "\n";
+      }
+      tfile = rawFile.get();
+    }
+    edm::DigestValues values;
+    if (opt.checksumThreads > 1 && opt.digests.onlyAdler32()) {
+      values.bytes = tfile->GetSize();
+      values.adler32 = edm::fileAdler32Parallel(pfn, values.bytes, opt.checksumThreads, opt.checksumBuffers, opt.checksumBufferSize);
+    } else {
+      values = edm::fileDigests(tfile, opt.digests, opt.checksumBuffers, opt.checksumBufferSize);
+    }
+    if (rawFile) rawFile->Close();
+    return values;
+  }
+
+  void printDigests(FileUtilOptions const& opt, edm::DigestValues const& values, std::ostream& out) {
+    if (opt.json) {
+      if (opt.digests.adler32) out << ",\"adler32sum\":" << values.adler32;
+      if (opt.digests.crc32c) out << ",\"crc32c\":" << values.crc32c;
+      if (opt.digests.sha256) out << ",\"sha256\":\"" << values.sha256 << '"';
+    } else {
+      if (opt.digests.adler32) out << ", " << std::hex << values.adler32 << std::dec << " adler32sum";
+      if (opt.digests.crc32c) out << ", " << std::hex << values.crc32c << std::dec << " crc32c";
+      if (opt.digests.sha256) out << ", " << values.sha256 << " sha256";
+    }
+  }
+
+  // Conversions between digest values and metadata cache records.
+  void digestsToRecord(FileUtilOptions const& opt, edm::DigestValues const& values, edm::FileMetadataCache::Record& record) {
+    std::ostringstream bytes;
+    bytes << values.bytes;
+    record["bytes"] = bytes.str();
+    if (opt.digests.adler32) {
+      std::ostringstream s;
+      s << values.adler32;
+      record["adler32"] = s.str();
+    }
+    if (opt.digests.crc32c) {
+      std::ostringstream s;
+      s << values.crc32c;
+      record["crc32c"] = s.str();
+    }
+    if (opt.digests.sha256) record["sha256"] = values.sha256;
+  }
+
+  // Returns false unless 'record' holds every selected digest.
+  bool digestsFromRecord(FileUtilOptions const& opt, edm::FileMetadataCache::Record const& record, edm::DigestValues& values) {
+    edm::FileMetadataCache::Record::const_iterator it;
+    if ((it = record.find("bytes")) == record.end()) return false;
+    std::istringstream(it->second) >> values.bytes;
+    if (opt.digests.adler32) {
+      if ((it = record.find("adler32")) == record.end()) return false;
+      std::istringstream(it->second) >> values.adler32;
+    }
+    if (opt.digests.crc32c) {
+      if ((it = record.find("crc32c")) == record.end()) return false;
+      std::istringstream(it->second) >> values.crc32c;
+    }
+    if (opt.digests.sha256) {
+      if ((it = record.find("sha256")) == record.end()) return false;
+      values.sha256 = it->second;
+    }
+    return true;
+  }
+
+  // The cache key of 'pfn' if it is a local file and a cache is in use.
+  std::string localCacheKey(FileUtilOptions const& opt, std::string const& pfn) {
+    std::string path;
+    if (opt.cache == 0 || !edm::localFilePath(pfn, path)) return std::string();
+    return edm::FileMetadataCache::localFileKey(path);
+  }
+
+  // Everything printed in the one line summary of a file: what
+  // edm::readFileSummary found in it, and its digests.
+  struct SummaryLine {
+    edm::FileSummary file;
+    edm::DigestValues digests;
+  };
+
+  // The trees edm::readFileSummary could not find.
+  void printMissingTrees(edm::FileSummary const& summary, std::ostream& out) {
+    std::pair<Long64_t, std::string> const trees[] = {
+      std::make_pair(summary.runs, edm::poolNames::runTreeName()),
+      std::make_pair(summary.lumis, edm::poolNames::luminosityBlockTreeName()),
+      std::make_pair(summary.events, edm::poolNames::eventTreeName())
+    };
+    for (unsigned int i = 0; i < sizeof(trees) / sizeof(trees[0]); ++i) {
+      if (trees[i].first < 0) {
+        out << "ERR cannot find a TTree named \"" << trees[i].second << "\"" << std::endl;
+      }
+    }
+  }
+
+  // Unless 'close' is set, the JSON record is left open for closeRecord.
+  void printSummary(FileUtilOptions const& opt, std::string const& datafile, SummaryLine const& summary,
+                    bool close, std::ostream& out) {
+    std::ostringstream auout;
+    if (opt.digests.any()) {
+      printDigests(opt, summary.digests, auout);
+    }
+    if (opt.uuid) {
+      if (opt.json) {
+        auout << ",\"uuid\":\"" << summary.file.uuid << '"';
+      } else {
+        auout << ", " << summary.file.uuid << " uuid";
+      }
+    }
+    if (opt.json) {
+      out << '{' << (opt.ndjson ? "\"record\":\"file\"," : "")
+          << "\"file\":\"" << edm::jsonEscape(datafile) << '"'
+          << ",\"runs\":" << summary.file.runs
+          << ",\"lumis\":" << summary.file.lumis
+          << ",\"events\":" << summary.file.events
+          << ",\"bytes\":" << summary.file.bytes
+          << auout.str();
+      if (close) out << '}' << std::endl;
+    } else {
+      out << datafile << " ("
+          << summary.file.runs << " runs, "
+          << summary.file.lumis << " lumis, "
+          << summary.file.events << " events, "
+          << summary.file.bytes << " bytes"
+          << auout.str()
+          << ")" << std::endl;
+    }
+  }
+
+  // Fill 'summary' from a cache record.  Returns false unless the record
+  // holds everything that was asked for.
+  bool summaryFromRecord(FileUtilOptions const& opt, edm::FileMetadataCache::Record const& record, SummaryLine& summary) {
+    edm::FileMetadataCache::Record::const_iterator it;
+    // Recovered files always go the long way, to repeat the warnings.
+    if ((it = record.find("recovered")) != record.end() && it->second == "1") return false;
+    if ((it = record.find("runs")) == record.end()) return false;
+    std::istringstream(it->second) >> summary.file.runs;
+    if ((it = record.find("lumis")) == record.end()) return false;
+    std::istringstream(it->second) >> summary.file.lumis;
+    if ((it = record.find("events")) == record.end()) return false;
+    std::istringstream(it->second) >> summary.file.events;
+    if (opt.uuid) {
+      if ((it = record.find("uuid")) == record.end()) return false;
+      summary.file.uuid = it->second;
+    }
+    if (!digestsFromRecord(opt, record, summary.digests)) return false;
+    summary.file.bytes = summary.digests.bytes;
+    return true;
+  }
+
+  // Checksum a file without opening it as an EDM file at all.
+  void checksumFile(FileUtilOptions const& opt, std::string const& lfn, std::string const& pfn, FileReport& report) {
+    std::ostringstream out;
+    if (!opt.json) out << lfn << "\n";
+    std::string const cacheKey = localCacheKey(opt, pfn);
+    edm::FileMetadataCache::Record cached;
+    edm::DigestValues values;
+    if (cacheKey.empty() || !opt.cache->lookup(cacheKey, cached) || !digestsFromRecord(opt, cached, values)) {
+      {
+        PhaseTimer timer(report.timing.checksum);
+        values = computeDigests(opt, pfn, 0);
+      }
+      report.timing.checksumBytes = values.bytes;
+      if (!cacheKey.empty()) {
+        edm::FileMetadataCache::Record record;
+        digestsToRecord(opt, values, record);
+        opt.cache->store(cacheKey, pfn, record);
+      }
+    }
+    std::string datafile = opt.decodeLFN ? pfn : lfn;
+    if (opt.json) {
+      out << '{' << (opt.ndjson ? "\"record\":\"file\"," : "")
+          << "\"file\":\"" << edm::jsonEscape(datafile) << '"'
+          << ",\"bytes\":" << values.bytes;
+      printDigests(opt, values, out);
+      report.recordOpen = timingInRecord(opt);
+      if (!report.recordOpen) out << '}' << std::endl;
+    } else {
+      out << datafile << " ("
+          << values.bytes << " bytes";
+      printDigests(opt, values, out);
+      out << ")" << std::endl;
+    }
+    report.text = out.str();
+  }
+
+  // Open one file, check that it is a valid collection, and build its
+  // one line summary.  Nothing is written to std::cout, so this may be
+  // called concurrently for different files.
+  void summarizeFile(FileUtilOptions const& opt, std::string const& lfn, std::string const& pfn, FileReport& report) {
+    std::ostringstream out;
+    std::ostringstream err;
+
+    std::string datafile = opt.decodeLFN ? pfn : lfn;
+
+    // An unchanged local file whose summary is cached need not be opened,
+    // unless it is needed for the detailed reports.
+    std::string const cacheKey = localCacheKey(opt, pfn);
+    bool const details = opt.ls || opt.print || opt.printBranchDetails || opt.branchStats || opt.events || opt.eventsInLumis;
+    if (!cacheKey.empty() && !details && !opt.verbose) {
+      edm::FileMetadataCache::Record cached;
+      SummaryLine summary;
+      if (opt.cache->lookup(cacheKey, cached) && summaryFromRecord(opt, cached, summary)) {
+        if (!opt.json) out << lfn << "\n";
+        report.recordOpen = timingInRecord(opt);
+        printSummary(opt, datafile, summary, !report.recordOpen, out);
+        report.text = out.str();
+        return;
+      }
+    }
+
+    // open a data file
+    if (!opt.json) out << lfn << "\n";
+    TFile *tfile = 0;
+    {
+      PhaseTimer timer(report.timing.open);
+      tfile = edm::openFileHdl(pfn, err);
+    }
+    if (tfile == 0) {
+      report.rc = 1;
+      report.text = out.str();
+      report.error = err.str();
+      return;
+    }
+    report.tfile = tfile;
+
+    if (opt.verbose) out << "ECU:: Opened " << pfn << std::endl;
+
+    // First check that this file is not auto-recovered
+    // Stop the job unless specified to do otherwise
+
+    bool isRecovered = tfile->TestBit(TFile::kRecovered);
+    if (isRecovered) {
+      if (opt.allowRecovery) {
+        if (!opt.json) {
+          out << pfn << " appears not to have been closed correctly and has been autorecovered \n";
+          out << "Proceeding anyway\n";
+        }
+      } else {
+        err << pfn << " appears not to have been closed correctly and has been autorecovered \n";
+        err << "Stopping. Use --allowRecovery to try ignoring this\n";
+        tfile->Close();
+        delete tfile;
+        report.tfile = 0;
+        report.rc = 1;
+        report.text = out.str();
+        report.error = err.str();
+        return;
+      }
+    } else {
+      if (opt.verbose) out << "ECU:: Collection not autorecovered. Continuing\n";
+    }
+
+    // Ok. Do we have the expected trees?
+    std::unique_ptr<PhaseTimer> treesTimer(new PhaseTimer(report.timing.trees));
+    for (unsigned int i = 0; i < opt.expectedTrees.size(); ++i) {
+      bool const found = opt.fastOpen ?
+        edm::treeEntriesFromKey(tfile, opt.expectedTrees[i].c_str()) != edm::kNoSuchTree :
+        tfile->Get(opt.expectedTrees[i].c_str()) != 0;
+      if (!found) {
+        err << "Tree " << opt.expectedTrees[i] << " appears to be missing. Not a valid collection\n";
+        err << "Exiting\n";
+        tfile->Close();
+        delete tfile;
+        report.tfile = 0;
+        report.rc = 1;
+        report.text = out.str();
+        report.error = err.str();
+        return;
+      } else {
+        if (opt.verbose) out << "ECU:: Found Tree " << opt.expectedTrees[i] << std::endl;
+      }
+    }
+
+    if (opt.verbose) out << "ECU:: Found all expected trees\n";
+
+    // Ok. How many events?
+    SummaryLine summary;
+    bool const withUuid = opt.uuid || (opt.cache != 0 && cacheKey.empty() && opt.digests.any());
+    summary.file = edm::readFileSummary(tfile, withUuid, opt.fastOpen);
+    treesTimer.reset();
+    // Missing trees are reported with this file, not straight to
+    // std::cout, which other threads may be writing to.  In JSON mode the
+    // report goes to stderr, to keep the output valid.
+    printMissingTrees(summary.file, opt.json ? err : out);
+
+    summary.digests.bytes = summary.file.bytes;
+    if (opt.digests.any()) {
+      // Files which cannot be identified by stat (remote ones) can still
+      // have their checksums cached under their FileID.
+      std::string const fidKey = (opt.cache != 0 && cacheKey.empty() && !summary.file.uuid.empty()) ?
+        edm::FileMetadataCache::fileIDKey(summary.file.uuid, summary.file.bytes) : std::string();
+      edm::FileMetadataCache::Record cached;
+      if (fidKey.empty() || !opt.cache->lookup(fidKey, cached) || !digestsFromRecord(opt, cached, summary.digests)) {
+        {
+          PhaseTimer timer(report.timing.checksum);
+          summary.digests = computeDigests(opt, pfn, tfile);
+        }
+        report.timing.checksumBytes = summary.digests.bytes;
+        if (!fidKey.empty()) {
+          edm::FileMetadataCache::Record record;
+          digestsToRecord(opt, summary.digests, record);
+          opt.cache->store(fidKey, pfn, record);
+        }
+      }
+    }
+
+    report.timing.bytesRead = tfile->GetBytesRead();
+    report.timing.readCalls = tfile->GetReadCalls();
+    report.recordOpen = timingInRecord(opt);
+    printSummary(opt, datafile, summary, !report.recordOpen, out);
+
+    if (!cacheKey.empty()) {
+      edm::FileMetadataCache::Record record;
+      if (opt.digests.any()) {
+        digestsToRecord(opt, summary.digests, record);
+      } else {
+        std::ostringstream bytes;
+        bytes << summary.file.bytes;
+        record["bytes"] = bytes.str();
+      }
+      std::ostringstream runs, lumis, events;
+      runs << summary.file.runs;
+      lumis << summary.file.lumis;
+      events << summary.file.events;
+      record["runs"] = runs.str();
+      record["lumis"] = lumis.str();
+      record["events"] = events.str();
+      record["recovered"] = isRecovered ? "1" : "0";
+      if (!summary.file.uuid.empty()) record["uuid"] = summary.file.uuid;
+      opt.cache->store(cacheKey, pfn, record);
+    }
+    report.text = out.str();
+    report.error = err.str();
+
+    // Nothing more is read from the file unless there are detailed reports,
+    // so do not keep it open until its turn to be printed.
+    if (!details) {
+      tfile->Close();
+      delete tfile;
+      report.tfile = 0;
+    }
+  }
+
+  void printMissingTree(FileUtilOptions const& opt, std::string const& datafile, std::ostream& out) {
+    if (opt.ndjson) {
+      out << "{\"record\":\"error\",\"file\":\"" << edm::jsonEscape(datafile) << '"'
+          << ",\"error\":\"tree " << edm::jsonEscape(opt.selectedTree) << " not found\"}\n";
+    } else {
+      out << "Tree " << opt.selectedTree << " appears to be missing. Could not find it in the file.\n";
+      out << "Exiting\n";
+    }
+  }
+
+  // One luminosity block of one file in the dataset summary.  The run and
+  // lumi are packed into a single key so that the whole dataset is one
+  // flat sorted array, rather than a map node per lumi.
+  struct DatasetLumi {
+    uint64_t key;    // run << 32 | lumi
+    uint32_t file;   // index into the input file list
+    uint32_t events;
+    bool operator<(DatasetLumi const& other) const {
+      return key < other.key || (key == other.key && file < other.file);
+    }
+  };
+
+  // Read the lumi event counts of every file on up to 'jobs' threads and
+  // print one merged run -> lumi -> {events, files} table, flagging lumis
+  // that are split across files.
+  int summarizeDataset(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                       std::vector<std::string> const& filesIn, edm::ServiceToken const& token) {
+    std::vector<std::vector<edm::LumiEventCount> > perFile(in.size());
+    std::vector<std::string> errors(in.size());
+    std::vector<DatasetLumi> lumis;
+    unsigned int nFailed = 0;
+    edm::orderedParallelFor(in.size(), jobs, 2 * jobs,
+      [&](unsigned int j) {
+        edm::ServiceRegistry::Operate workerOperate(token);
+        std::ostringstream err;
+        std::unique_ptr<TFile> tfile(edm::openFileHdl(filesIn[j], err));
+        if (!tfile) {
+          errors[j] = err.str();
+          return;
+        }
+        if (!edm::readEventsInLumis(tfile.get(), perFile[j])) {
+          errors[j] = filesIn[j] + " has neither IndexIntoFile nor FileIndex\n";
+        }
+        tfile->Close();
+      },
+      [&](unsigned int j) {
+        if (!errors[j].empty()) {
+          std::cerr << errors[j];
+          ++nFailed;
+        }
+        for (std::vector<edm::LumiEventCount>::const_iterator it = perFile[j].begin(), itEnd = perFile[j].end(); it != itEnd; ++it) {
+          DatasetLumi lumi;
+          lumi.key = (uint64_t(it->run) << 32) | it->lumi;
+          lumi.file = j;
+          lumi.events = it->events;
+          lumis.push_back(lumi);
+        }
+        std::vector<edm::LumiEventCount>().swap(perFile[j]);
+      });
+    std::sort(lumis.begin(), lumis.end());
+
+    if (!opt.json) {
+      std::cout << "\n" << std::setw(15) << "Run"
+                << std::setw(15) << "Lumi"
+                << std::setw(15) << "# Events"
+                << std::setw(10) << "# Files"
+                << "\n";
+    }
+    unsigned long long nLumis = 0, nSplit = 0, nEvents = 0;
+    unsigned long long nRuns = 0;
+    uint64_t lastRun = ~uint64_t(0);
+    std::vector<DatasetLumi>::const_iterator it = lumis.begin();
+    while (it != lumis.end()) {
+      std::vector<DatasetLumi>::const_iterator itEnd = it;
+      unsigned long long events = 0;
+      unsigned int files = 0;
+      for (; itEnd != lumis.end() && itEnd->key == it->key; ++itEnd) {
+        events += itEnd->events;
+        if (itEnd == it || itEnd->file != (itEnd - 1)->file) ++files;
+      }
+      RunNumber_t run = it->key >> 32;
+      LuminosityBlockNumber_t lumi = it->key & 0xffffffffU;
+      bool split = files > 1;
+      ++nLumis;
+      nEvents += events;
+      if (split) ++nSplit;
+      if (run != lastRun) {
+        ++nRuns;
+        lastRun = run;
+      }
+      if (opt.json) {
+        std::cout << "{\"record\":\"datasetLumi\",\"run\":" << run << ",\"lumi\":" << lumi
+                  << ",\"events\":" << events << ",\"files\":[";
+        for (std::vector<DatasetLumi>::const_iterator f = it; f != itEnd; ++f) {
+          if (f != it && f->file == (f - 1)->file) continue;
+          if (f != it) std::cout << ',';
+          std::cout << '"' << edm::jsonEscape(opt.decodeLFN ? filesIn[f->file] : in[f->file]) << '"';
+        }
+        std::cout << "],\"split\":" << (split ? "true" : "false") << "}\n";
+      } else {
+        std::cout << std::setw(15) << run
+                  << std::setw(15) << lumi
+                  << std::setw(15) << events
+                  << std::setw(10) << files
+                  << (split ? "  split" : "") << "\n";
+      }
+      it = itEnd;
+    }
+
+    if (opt.json) {
+      std::cout << "{\"record\":\"dataset\",\"files\":" << in.size() << ",\"failed\":" << nFailed
+                << ",\"runs\":" << nRuns << ",\"lumis\":" << nLumis << ",\"events\":" << nEvents
+                << ",\"splitLumis\":" << nSplit << "}\n";
+    } else {
+      if (nSplit != 0) {
+        std::cout << "\nLumis split across files:\n";
+        for (it = lumis.begin(); it != lumis.end(); ) {
+          std::vector<DatasetLumi>::const_iterator itEnd = it;
+          while (itEnd != lumis.end() && itEnd->key == it->key) ++itEnd;
+          if (itEnd - it > 1 && (itEnd - 1)->file != it->file) {
+            std::cout << "Run " << (it->key >> 32) << " lumi " << (it->key & 0xffffffffU) << ":\n";
+            // A file may list the lumi more than once; print its total.
+            for (std::vector<DatasetLumi>::const_iterator f = it; f != itEnd; ) {
+              unsigned long long fileEvents = 0;
+              std::vector<DatasetLumi>::const_iterator fEnd = f;
+              for (; fEnd != itEnd && fEnd->file == f->file; ++fEnd) fileEvents += fEnd->events;
+              std::cout << "  " << (opt.decodeLFN ? filesIn[f->file] : in[f->file]) << " (" << fileEvents << " events)\n";
+              f = fEnd;
+            }
+          }
+          it = itEnd;
+        }
+      }
+      std::cout << "\n" << in.size() - nFailed << " files, " << nRuns << " runs, " << nLumis << " lumis, "
+                << nEvents << " events, " << nSplit << " lumis split across files\n";
+    }
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  // Read the events of every file on up to 'jobs' threads and write them
+  // to the sidecar event index 'path'.
+  int buildEventIndex(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                      std::vector<std::string> const& filesIn, edm::ServiceToken const& token, std::string const& path) {
+    std::vector<std::vector<edm::EventEntry> > perFile(in.size());
+    std::vector<std::string> errors(in.size());
+    std::vector<edm::EventIndexRecord> records;
+    std::vector<std::string> fileNames;
+    fileNames.reserve(in.size());
+    unsigned int nFailed = 0;
+    edm::orderedParallelFor(in.size(), jobs, 2 * jobs,
+      [&](unsigned int j) {
+        edm::ServiceRegistry::Operate workerOperate(token);
+        std::ostringstream err;
+        std::unique_ptr<TFile> tfile(edm::openFileHdl(filesIn[j], err));
+        if (!tfile) {
+          errors[j] = err.str();
+          return;
+        }
+        if (!edm::readEventEntries(tfile.get(), perFile[j])) {
+          errors[j] = filesIn[j] + " has no event index\n";
+        }
+        tfile->Close();
+      },
+      [&](unsigned int j) {
+        if (!errors[j].empty()) {
+          std::cerr << errors[j];
+          ++nFailed;
+          return;
+        }
+        uint32_t file = fileNames.size();
+        fileNames.push_back(opt.decodeLFN ? filesIn[j] : in[j]);
+        for (std::vector<edm::EventEntry>::const_iterator it = perFile[j].begin(), itEnd = perFile[j].end(); it != itEnd; ++it) {
+          edm::EventIndexRecord record;
+          record.run = it->run;
+          record.lumi = it->lumi;
+          record.event = it->event;
+          record.entry = it->entry;
+          record.file = file;
+          record.unused = 0;
+          records.push_back(record);
+        }
+        std::vector<edm::EventEntry>().swap(perFile[j]);
+      });
+    edm::writeEventIndex(path, fileNames, records);
+    std::cout << "Wrote " << records.size() << " events from " << fileNames.size() << " files to " << path << "\n";
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  // One wanted event of a --pick list.
+  struct PickedEvent {
+    RunNumber_t run;
+    LuminosityBlockNumber_t lumi;
+    EventNumber_t event;
+    bool operator<(PickedEvent const& other) const {
+      if (run != other.run) return run < other.run;
+      if (lumi != other.lumi) return lumi < other.lumi;
+      return event < other.event;
+    }
+    bool operator==(PickedEvent const& other) const {
+      return run == other.run && lumi == other.lumi && event == other.event;
+    }
+  };
+
+  // Find where each run:lumi:event listed in 'listPath' is stored.  The
+  // index of each file is scanned on up to 'jobs' threads; only the events
+  // of wanted lumis have their event numbers read.  The locations are
+  // printed per file, in input order, sorted by entry.
+  int pickEvents(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                 std::vector<std::string> const& filesIn, edm::ServiceToken const& token, std::string const& listPath) {
+    std::ifstream list(listPath.c_str());
+    if (!list) {
+      std::cout << "Event list '" << listPath << "' not found or not readable\n";
+      return 1;
+    }
+    std::vector<PickedEvent> wanted;
+    std::string line;
+    while (std::getline(list, line)) {
+      if (line.empty() || line[0] == '#') continue;
+      std::replace(line.begin(), line.end(), ':', ' ');
+      std::istringstream is(line);
+      PickedEvent event;
+      if (!(is >> event.run >> event.lumi >> event.event)) {
+        std::cout << "Bad line in event list '" << listPath << "', expected run:lumi:event\n";
+        return 1;
+      }
+      wanted.push_back(event);
+    }
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    std::vector<uint64_t> wantedLumis;
+    wantedLumis.reserve(wanted.size());
+    for (std::vector<PickedEvent>::const_iterator it = wanted.begin(), itEnd = wanted.end(); it != itEnd; ++it) {
+      wantedLumis.push_back((uint64_t(it->run) << 32) | it->lumi);
+    }
+    wantedLumis.erase(std::unique(wantedLumis.begin(), wantedLumis.end()), wantedLumis.end());
+    edm::LumiSelector wantLumi = [&wantedLumis](RunNumber_t run, LuminosityBlockNumber_t lumi) {
+      return std::binary_search(wantedLumis.begin(), wantedLumis.end(), (uint64_t(run) << 32) | lumi);
+    };
+
+    std::vector<std::vector<edm::EventEntry> > found(in.size());
+    std::vector<std::string> errors(in.size());
+    std::vector<char> seen(wanted.size(), 0);
+    unsigned int nFailed = 0;
+    edm::orderedParallelFor(in.size(), jobs, 2 * jobs,
+      [&](unsigned int j) {
+        edm::ServiceRegistry::Operate workerOperate(token);
+        std::ostringstream err;
+        std::unique_ptr<TFile> tfile(edm::openFileHdl(filesIn[j], err));
+        if (!tfile) {
+          errors[j] = err.str();
+          return;
+        }
+        std::vector<edm::EventEntry> candidates;
+        if (!edm::readEventEntries(tfile.get(), candidates, wantLumi)) {
+          errors[j] = filesIn[j] + " has no event index\n";
+        }
+        tfile->Close();
+        for (std::vector<edm::EventEntry>::const_iterator it = candidates.begin(), itEnd = candidates.end(); it != itEnd; ++it) {
+          PickedEvent event = {it->run, it->lumi, it->event};
+          if (std::binary_search(wanted.begin(), wanted.end(), event)) found[j].push_back(*it);
+        }
+        std::sort(found[j].begin(), found[j].end(),
+                  [](edm::EventEntry const& a, edm::EventEntry const& b) { return a.entry < b.entry; });
+      },
+      [&](unsigned int j) {
+        if (!errors[j].empty()) {
+          std::cerr << errors[j];
+          ++nFailed;
+        }
+        if (found[j].empty()) return;
+        if (!opt.json) std::cout << filesIn[j] << "\n";
+        for (std::vector<edm::EventEntry>::const_iterator it = found[j].begin(), itEnd = found[j].end(); it != itEnd; ++it) {
+          PickedEvent event = {it->run, it->lumi, it->event};
+          seen[std::lower_bound(wanted.begin(), wanted.end(), event) - wanted.begin()] = 1;
+          if (opt.json) {
+            std::cout << "{\"record\":\"pick\",\"file\":\"" << edm::jsonEscape(filesIn[j]) << '"'
+                      << ",\"entry\":" << it->entry << ",\"run\":" << it->run
+                      << ",\"lumi\":" << it->lumi << ",\"event\":" << it->event << "}\n";
+          } else {
+            std::cout << std::setw(15) << it->entry << "  " << it->run << ':' << it->lumi << ':' << it->event << "\n";
+          }
+        }
+        std::vector<edm::EventEntry>().swap(found[j]);
+      });
+
+    unsigned int nMissing = 0;
+    for (unsigned int i = 0; i < wanted.size(); ++i) {
+      if (seen[i]) continue;
+      std::cerr << "Event " << wanted[i].run << ':' << wanted[i].lumi << ':' << wanted[i].event << " not found\n";
+      ++nMissing;
+    }
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+    }
+    if (nMissing != 0) {
+      std::cerr << nMissing << " of " << wanted.size() << " events not found\n";
+    }
+    return (nFailed != 0 || nMissing != 0) ? 1 : 0;
+  }
+
+  // Read the merge relevant metadata of every file on up to 'jobs'
+  // threads.  Files which cannot be read are reported on std::cerr and
+  // left out of 'infos' and 'names'.  Returns the number of those.
+  unsigned int readMergeInfos(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                              std::vector<std::string> const& filesIn, edm::ServiceToken const& token,
+                              std::vector<edm::FileMergeInfo>& infos, std::vector<std::string>& names) {
+    std::vector<edm::FileMergeInfo> all(in.size());
+    std::vector<std::string> errors(in.size());
+    edm::parallelFor(in.size(), jobs,
+      [&](unsigned int j) {
+        edm::ServiceRegistry::Operate workerOperate(token);
+        std::ostringstream err;
+        std::unique_ptr<TFile> tfile(edm::openFileHdl(filesIn[j], err));
+        if (!tfile) {
+          errors[j] = err.str();
+          return;
+        }
+        if (!edm::readFileMergeInfo(tfile.get(), all[j])) {
+          errors[j] = filesIn[j] + " has no metadata or index\n";
+        }
+        tfile->Close();
+      });
+    unsigned int nFailed = 0;
+    for (unsigned int j = 0; j < in.size(); ++j) {
+      if (!errors[j].empty()) {
+        std::cerr << errors[j];
+        ++nFailed;
+        continue;
+      }
+      infos.push_back(all[j]);
+      names.push_back(opt.decodeLFN ? filesIn[j] : in[j]);
+    }
+    return nFailed;
+  }
+
+  // Report which files a PoolSource -> PoolOutputModule merge would fast
+  // clone together, and why the others would not be.
+  int printMergePlan(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                     std::vector<std::string> const& filesIn, edm::ServiceToken const& token) {
+    std::vector<edm::FileMergeInfo> infos;
+    std::vector<std::string> names;
+    unsigned int nFailed = readMergeInfos(opt, jobs, in, filesIn, token, infos, names);
+    std::vector<edm::MergeGroup> groups = edm::planFastCloneGroups(infos);
+    for (unsigned int g = 0; g < groups.size(); ++g) {
+      edm::MergeGroup const& group = groups[g];
+      if (opt.json) {
+        std::cout << "{\"record\":\"mergeGroup\",\"group\":" << g + 1
+                  << ",\"fastClone\":" << (group.fastClone ? "true" : "false") << ",\"files\":[";
+        for (unsigned int i = 0; i < group.files.size(); ++i) {
+          std::cout << (i == 0 ? "" : ",") << '"' << edm::jsonEscape(names[group.files[i]]) << '"';
+        }
+        std::cout << "],\"reasons\":[";
+        for (unsigned int i = 0; i < group.reasons.size(); ++i) {
+          std::cout << (i == 0 ? "" : ",") << '"' << edm::jsonEscape(group.reasons[i]) << '"';
+        }
+        std::cout << "],\"notes\":[";
+        for (unsigned int i = 0; i < group.notes.size(); ++i) {
+          std::cout << (i == 0 ? "" : ",") << '"' << edm::jsonEscape(group.notes[i]) << '"';
+        }
+        std::cout << "]}\n";
+      } else {
+        std::cout << "Merge group " << g + 1 << ": " << group.files.size() << " file(s), "
+                  << (group.fastClone ? "can be fast cloned" : "cannot be fast cloned") << "\n";
+        for (std::vector<std::string>::const_iterator it = group.reasons.begin(), itEnd = group.reasons.end(); it != itEnd; ++it) {
+          std::cout << (group.fastClone ? "  kept apart from the first group: " : "  because: ") << *it << "\n";
+        }
+        for (std::vector<std::string>::const_iterator it = group.notes.begin(), itEnd = group.notes.end(); it != itEnd; ++it) {
+          std::cout << "  note: " << *it << "\n";
+        }
+        for (std::vector<unsigned int>::const_iterator it = group.files.begin(), itEnd = group.files.end(); it != itEnd; ++it) {
+          std::cout << "    " << names[*it] << "\n";
+        }
+      }
+    }
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  // Pack the input files into merge groups of about 'targetBytes' which
+  // keep fast cloning and run:lumi order, and print one file list per
+  // group.  If 'prefix' is not empty each list is also written to
+  // <prefix><group>.txt, one name per line, for use as PoolSource input.
+  int printMergeGroups(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                       std::vector<std::string> const& filesIn, edm::ServiceToken const& token,
+                       unsigned long long targetBytes, std::string const& prefix) {
+    std::vector<edm::FileMergeInfo> infos;
+    std::vector<std::string> names;
+    unsigned int nFailed = readMergeInfos(opt, jobs, in, filesIn, token, infos, names);
+    std::vector<edm::MergeGroup> groups = edm::packMergeGroups(infos, targetBytes);
+    int rc = 0;
+    for (unsigned int g = 0; g < groups.size(); ++g) {
+      edm::MergeGroup const& group = groups[g];
+      unsigned long long bytes = 0;
+      Long64_t events = 0;
+      for (std::vector<unsigned int>::const_iterator it = group.files.begin(), itEnd = group.files.end(); it != itEnd; ++it) {
+        bytes += infos[*it].bytes;
+        events += infos[*it].events;
+      }
+      std::ostringstream listName;
+      if (!prefix.empty()) {
+        listName << prefix << g + 1 << ".txt";
+        std::ofstream list(listName.str().c_str());
+        for (std::vector<unsigned int>::const_iterator it = group.files.begin(), itEnd = group.files.end(); it != itEnd; ++it) {
+          list << names[*it] << "\n";
+        }
+        if (!list) {
+          std::cerr << "Could not write " << listName.str() << "\n";
+          rc = 1;
+        }
+      }
+      edm::FileMergeInfo const& first = infos[group.files.front()];
+      edm::FileMergeInfo const& last = infos[group.files.back()];
+      if (opt.json) {
+        std::cout << "{\"record\":\"mergeGroup\",\"group\":" << g + 1
+                  << ",\"fastClone\":" << (group.fastClone ? "true" : "false")
+                  << ",\"bytes\":" << bytes << ",\"events\":" << events
+                  << ",\"first\":\"" << first.firstRun << ':' << first.firstLumi << '"'
+                  << ",\"last\":\"" << last.lastRun << ':' << last.lastLumi << '"';
+        if (!prefix.empty()) std::cout << ",\"list\":\"" << edm::jsonEscape(listName.str()) << '"';
+        std::cout << ",\"files\":[";
+        for (unsigned int i = 0; i < group.files.size(); ++i) {
+          std::cout << (i == 0 ? "" : ",") << '"' << edm::jsonEscape(names[group.files[i]]) << '"';
+        }
+        std::cout << "]}\n";
+      } else {
+        std::cout << "Merge group " << g + 1 << ": " << group.files.size() << " file(s), "
+                  << bytes << " bytes, " << events << " events, runs/lumis "
+                  << first.firstRun << ':' << first.firstLumi << " to " << last.lastRun << ':' << last.lastLumi
+                  << (group.fastClone ? "" : ", cannot be fast cloned");
+        if (!prefix.empty()) std::cout << ", written to " << listName.str();
+        std::cout << "\n";
+        for (std::vector<unsigned int>::const_iterator it = group.files.begin(), itEnd = group.files.end(); it != itEnd; ++it) {
+          std::cout << "    " << names[*it] << "\n";
+        }
+      }
+    }
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+      rc = 1;
+    }
+    return rc;
+  }
+
+  // Report every run:lumi:event stored more than once in the input files,
+  // with all its locations.  The events of the files are read on up to
+  // 'jobs' threads and fed to a DuplicateFinder, which keeps within
+  // 'memoryBudget' bytes by spilling to 'spillDirectory'.
+  int findDuplicates(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                     std::vector<std::string> const& filesIn, edm::ServiceToken const& token,
+                     size_t memoryBudget, std::string const& spillDirectory) {
+    std::vector<std::vector<edm::EventEntry> > perFile(in.size());
+    std::vector<std::string> errors(in.size());
+    std::vector<std::string> names(in.size());
+    edm::DuplicateFinder finder(memoryBudget, spillDirectory);
+    unsigned int nFailed = 0;
+    edm::orderedParallelFor(in.size(), jobs, 2 * jobs,
+      [&](unsigned int j) {
+        edm::ServiceRegistry::Operate workerOperate(token);
+        std::ostringstream err;
+        std::unique_ptr<TFile> tfile(edm::openFileHdl(filesIn[j], err));
+        if (!tfile) {
+          errors[j] = err.str();
+          return;
+        }
+        if (!edm::readEventEntries(tfile.get(), perFile[j])) {
+          errors[j] = filesIn[j] + " has no event index\n";
+        }
+        tfile->Close();
+      },
+      [&](unsigned int j) {
+        names[j] = opt.decodeLFN ? filesIn[j] : in[j];
+        if (!errors[j].empty()) {
+          std::cerr << errors[j];
+          ++nFailed;
+        }
+        for (std::vector<edm::EventEntry>::const_iterator it = perFile[j].begin(), itEnd = perFile[j].end(); it != itEnd; ++it) {
+          edm::EventIndexRecord record;
+          record.run = it->run;
+          record.lumi = it->lumi;
+          record.event = it->event;
+          record.entry = it->entry;
+          record.file = j;
+          record.unused = 0;
+          finder.add(record);
+        }
+        std::vector<edm::EventEntry>().swap(perFile[j]);
+      });
+
+    unsigned long long nDuplicates = finder.findDuplicates(
+      [&](edm::EventIndexRecord const* begin, edm::EventIndexRecord const* end) {
+        if (opt.json) {
+          std::cout << "{\"record\":\"duplicate\",\"run\":" << begin->run << ",\"lumi\":" << begin->lumi
+                    << ",\"event\":" << begin->event << ",\"locations\":[";
+          for (edm::EventIndexRecord const* it = begin; it != end; ++it) {
+            std::cout << (it == begin ? "" : ",") << "{\"file\":\"" << edm::jsonEscape(names[it->file])
+                      << "\",\"entry\":" << it->entry << '}';
+          }
+          std::cout << "]}\n";
+        } else {
+          std::cout << "Event " << begin->run << ':' << begin->lumi << ':' << begin->event
+                    << " found " << (end - begin) << " times:\n";
+          for (edm::EventIndexRecord const* it = begin; it != end; ++it) {
+            std::cout << "    " << names[it->file] << " entry " << it->entry << "\n";
+          }
+        }
+      });
+    if (opt.json) {
+      std::cout << "{\"record\":\"duplicates\",\"files\":" << in.size() << ",\"failed\":" << nFailed
+                << ",\"events\":" << finder.size() << ",\"duplicated\":" << nDuplicates
+                << ",\"spilledBytes\":" << finder.spilledBytes() << "}\n";
+    } else {
+      std::cout << finder.size() << " events in " << in.size() - nFailed << " files, "
+                << nDuplicates << " of them stored more than once\n";
+    }
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+    }
+    return (nFailed != 0 || nDuplicates != 0) ? 1 : 0;
+  }
+
+  // Check every basket of every file, one file at a time with the
+  // branches of each shared among 'jobs' threads.
+  int verifyFiles(FileUtilOptions const& opt, unsigned int jobs, std::vector<std::string> const& in,
+                  std::vector<std::string> const& filesIn) {
+    unsigned int nBad = 0;
+    for (unsigned int j = 0; j < in.size(); ++j) {
+      std::string const datafile = opt.decodeLFN ? filesIn[j] : in[j];
+      std::vector<edm::BadBasket> bad;
+      Long64_t nBaskets = 0;
+      bool const opened = edm::verifyBaskets(filesIn[j], jobs, bad, nBaskets);
+      if (opened && bad.empty()) {
+        if (opt.json) {
+          std::cout << "{\"record\":\"verify\",\"file\":\"" << edm::jsonEscape(datafile) << "\",\"baskets\":" << nBaskets << ",\"bad\":0}\n";
+        } else {
+          std::cout << datafile << ": " << nBaskets << " baskets OK\n";
+        }
+        continue;
+      }
+      ++nBad;
+      if (!opened) {
+        if (opt.json) {
+          std::cout << "{\"record\":\"error\",\"file\":\"" << edm::jsonEscape(datafile) << "\",\"error\":\"could not open file\"}\n";
+        } else {
+          std::cout << datafile << ": could not open file\n";
+        }
+        continue;
+      }
+      if (opt.json) {
+        for (std::vector<edm::BadBasket>::const_iterator it = bad.begin(), itEnd = bad.end(); it != itEnd; ++it) {
+          std::cout << "{\"record\":\"badBasket\",\"file\":\"" << edm::jsonEscape(datafile) << '"'
+                    << ",\"tree\":\"" << edm::jsonEscape(it->tree) << '"'
+                    << ",\"branch\":\"" << edm::jsonEscape(it->branch) << '"'
+                    << ",\"basket\":" << it->basket
+                    << ",\"firstEntry\":" << it->firstEntry << ",\"lastEntry\":" << it->lastEntry
+                    << ",\"seek\":" << it->seek
+                    << ",\"reason\":\"" << edm::jsonEscape(it->reason) << "\"}\n";
+        }
+        std::cout << "{\"record\":\"verify\",\"file\":\"" << edm::jsonEscape(datafile) << "\",\"baskets\":" << nBaskets
+                  << ",\"bad\":" << bad.size() << "}\n";
+      } else {
+        std::cout << datafile << ": " << bad.size() << " of " << nBaskets << " baskets bad\n";
+        for (std::vector<edm::BadBasket>::const_iterator it = bad.begin(), itEnd = bad.end(); it != itEnd; ++it) {
+          std::cout << "    " << it->tree << ' ' << it->branch << " basket " << it->basket
+                    << ", entries " << it->firstEntry << " to " << it->lastEntry
+                    << ", offset " << it->seek << ": " << it->reason << "\n";
+        }
+      }
+    }
+    if (nBad != 0) {
+      std::cerr << nBad << " of " << in.size() << " files failed verification\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  // Parses one --query: "run", "run:lumi" or "run:lumi:event", or two of
+  // those separated by '-' for an inclusive range.  Missing trailing
+  // numbers match everything.
+  bool parseEventQuery(std::string const& query, edm::EventIndexRecord& first, edm::EventIndexRecord& last) {
+    std::string::size_type dash = query.find('-');
+    std::string const from = query.substr(0, dash);
+    std::string const to = dash == std::string::npos ? from : query.substr(dash + 1);
+    edm::EventIndexRecord bound[2];
+    std::string const* text[2] = {&from, &to};
+    for (int b = 0; b < 2; ++b) {
+      unsigned long long numbers[3] = {0, 0, 0};
+      int n = 0;
+      std::istringstream is(*text[b]);
+      while (n < 3 && is >> numbers[n]) {
+        ++n;
+        if (is.peek() != ':') break;
+        is.get();
+      }
+      is.clear();
+      std::string rest;
+      std::getline(is, rest);
+      if (n == 0 || !rest.empty()) return false;
+      if (b == 1) {
+        if (n < 2) numbers[1] = 0xffffffffULL;
+        if (n < 3) numbers[2] = ~0ULL;
+      }
+      bound[b].run = numbers[0];
+      bound[b].lumi = numbers[1];
+      bound[b].event = numbers[2];
+    }
+    first = bound[0];
+    last = bound[1];
+    return true;
+  }
+
+  // -d on its own: print the PFN of every input.  With 'checkExists' the
+  // PFNs are also checked concurrently (stat for local files, an open for
+  // remote ones) and those which do not exist are reported.
+  int printDecodedLFNs(unsigned int jobs, std::vector<std::string> const& in,
+                       std::vector<std::string> const& filesIn, bool checkExists) {
+    if (!checkExists) {
+      for (unsigned int j = 0; j < in.size(); ++j) {
+        std::cout << filesIn[j] << std::endl;
+      }
+      return 0;
+    }
+    gErrorIgnoreLevel = kFatal;
+    std::vector<char> exists(in.size(), 0);
+    unsigned int nMissing = 0;
+    edm::orderedParallelFor(in.size(), jobs, 4 * jobs,
+      [&](unsigned int j) {
+        std::string path;
+        if (edm::localFilePath(filesIn[j], path)) {
+          struct stat st;
+          exists[j] = (stat(path.c_str(), &st) == 0);
+        } else {
+          // Open it as a plain byte stream; reading its keys and streamer
+          // info would cost round trips that say nothing about existence.
+          std::string const rawName = filesIn[j] + (filesIn[j].find('?') == std::string::npos ? "?filetype=raw" : "&filetype=raw");
+          std::unique_ptr<TFile> tfile(TFile::Open(rawName.c_str()));
+          exists[j] = (tfile.get() != 0 && !tfile->IsZombie());
+          if (tfile) tfile->Close();
+        }
+      },
+      [&](unsigned int j) {
+        std::cout << filesIn[j] << std::endl;
+        if (!exists[j]) {
+          std::cerr << "File " << in[j] << " (" << filesIn[j] << ") does not exist or could not be opened.\n";
+          ++nMissing;
+        }
+      });
+    gErrorIgnoreLevel = kError;
+    return nMissing == 0 ? 0 : 1;
+  }
+
+  // Answer --query arguments from the sidecar event index 'path', without
+  // opening any ROOT file.
+  int lookupEvents(std::string const& path, std::vector<std::string> const& queries, bool json) {
+    edm::EventIndexFile index(path);
+    int rc = 0;
+    for (std::vector<std::string>::const_iterator q = queries.begin(), qEnd = queries.end(); q != qEnd; ++q) {
+      edm::EventIndexRecord first, last;
+      if (!parseEventQuery(*q, first, last)) {
+        std::cerr << "Bad query '" << *q << "', expected run[:lumi[:event]][-run[:lumi[:event]]]\n";
+        rc = 1;
+        continue;
+      }
+      std::pair<edm::EventIndexFile::const_iterator, edm::EventIndexFile::const_iterator> found = index.range(first, last);
+      if (found.first == found.second) rc = 1;
+      for (edm::EventIndexFile::const_iterator it = found.first; it != found.second; ++it) {
+        std::string const& file = index.fileName(*it);
+        if (json) {
+          std::cout << "{\"record\":\"event\",\"query\":\"" << edm::jsonEscape(*q) << '"'
+                    << ",\"run\":" << it->run << ",\"lumi\":" << it->lumi << ",\"event\":" << it->event
+                    << ",\"file\":\"" << edm::jsonEscape(file) << "\",\"entry\":" << it->entry << "}\n";
+        } else {
+          std::cout << it->run << ':' << it->lumi << ':' << it->event << ' ' << file << ' ' << it->entry << "\n";
+        }
+      }
+    }
+    return rc;
+  }
+
+  // The detailed reports, written to 'out'.  The output of -l and the
+  // text of -b always go to std::cout, so those two are only run on the
+  // main thread, one file at a time, in input order.
+  int printFileDetails(FileUtilOptions const& opt, std::string const& datafile, TFile* tfile, std::ostream& out) {
+    edm::ReportFormat const format = opt.ndjson ? edm::kNDJSONReport : edm::kTextReport;
+
+    // Look at the collection contents
+    if (opt.ls) {
+      if (tfile != 0) tfile->ls();
+    }
+
+    // Print out each tree
+    if (opt.print) {
+      TTree *printTree = (TTree*)tfile->Get(opt.selectedTree.c_str());
+      if (printTree == 0) {
+        printMissingTree(opt, datafile, out);
+        return 1;
+      }
+      edm::printBranchNames(printTree, format, datafile, out);
+    }
+
+    if (opt.printBranchDetails) {
+      TTree *printTree = (TTree*)tfile->Get(opt.selectedTree.c_str());
+      if (printTree == 0) {
+        printMissingTree(opt, datafile, out);
+        return 1;
+      }
+      edm::longBranchPrint(printTree, format, datafile, out);
+    }
+
+    if (opt.branchStats) {
+      TTree *statsTree = (TTree*)tfile->Get(opt.selectedTree.c_str());
+      if (statsTree == 0) {
+        printMissingTree(opt, datafile, out);
+        return 1;
+      }
+      edm::printBranchStats(statsTree, opt.branchStatsSortBy, format, datafile, out);
+    }
+
+    // Print out event lists
+    if (opt.events) {
+      edm::printEventLists(tfile, format, datafile, out);
+    }
+
+    if(opt.eventsInLumis) {
+      edm::printEventsInLumis(tfile, format, datafile, out);
+    }
+    return 0;
+  }
+
+  // --serve: answer report requests from edmFileUtilClient on 'socketPath',
+  // up to 'jobs' at a time, until asked to stop.  Each report gives the
+  // same output as the corresponding command line option would for one
+  // file, in the format selected when the server was started.
+  int serveQueries(FileUtilOptions const& opt, unsigned int jobs, std::string const& socketPath,
+                   edm::LfnResolver& resolver, edm::ServiceToken const& token) {
+    // Build the catalogs once, not on the first request.  A server without
+    // a site configuration can still answer requests for PFNs.
+    try {
+      resolver.loadCatalog();
+    } catch (cms::Exception const& e) {
+      std::cerr << "Warning: no LFN catalog, only PFNs can be served:\n" << e.explainSelf();
+    }
+    edm::QueryServer server(socketPath);
+    std::cerr << "edmFileUtil serving on " << socketPath << " with " << jobs << " workers\n";
+    unsigned long long const nServed = server.run(jobs,
+      [&](std::string const& report, std::string const& lfn, std::string& output) {
+        edm::ServiceRegistry::Operate workerOperate(token);
+        FileUtilOptions requestOpt(opt);
+        requestOpt.verbose = requestOpt.ls = requestOpt.printBranchDetails = false;
+        requestOpt.print = (report == "print");
+        requestOpt.branchStats = (report == "branchStats");
+        requestOpt.events = (report == "events");
+        requestOpt.eventsInLumis = (report == "eventsInLumis");
+        bool const details = requestOpt.print || requestOpt.branchStats || requestOpt.events || requestOpt.eventsInLumis;
+        if (!details && report != "summary" && report != "decodeLFN") {
+          output = "Unknown report '" + report + "'.  Use summary, decodeLFN, events, eventsInLumis, print or branchStats.\n";
+          return false;
+        }
+        std::string const pfn = resolver.resolve(std::vector<std::string>(1, lfn))[0];
+        if (report == "decodeLFN") {
+          output = pfn + "\n";
+          return true;
+        }
+        FileReport fileReport;
+        summarizeFile(requestOpt, lfn, pfn, fileReport);
+        std::ostringstream out;
+        out << fileReport.text;
+        if (fileReport.rc == 0 && details) {
+          fileReport.rc = printFileDetails(requestOpt, opt.decodeLFN ? pfn : lfn, fileReport.tfile, out);
+        }
+        closeRecord(fileReport, out);
+        if (fileReport.tfile != 0) {
+          fileReport.tfile->Close();
+          delete fileReport.tfile;
+        }
+        output = out.str() + fileReport.error;
+        return fileReport.rc == 0;
+      });
+    std::cerr << "edmFileUtil served " << nServed << " requests\n";
+    return 0;
+  }
+}
 
 int main(int argc, char* argv[]) {
 
@@ -38,23 +1347,50 @@ int main(int argc, char* argv[]) {
     ("file,f", boost::program_options::value<std::vector<std::string> >(), "data file (-f or -F required)")
     ("Files,F", boost::program_options::value<std::string>(), "text file containing names of data files, one per line")
     ("catalog,c", boost::program_options::value<std::string>(), "catalog")
-    ("decodeLFN,d", "Convert LFN to PFN")
+    ("decodeLFN,d", "Convert LFN to PFN.  Any number of names may be given (use -F for long lists); they are all resolved by a single catalog.")
+    ("checkExists", "With -d alone, also check that every PFN exists, --jobs at a time.  Missing files are reported on stderr and make the exit code nonzero.")
+    ("lfnCache", boost::program_options::value<std::string>(), "Cache file for LFN to PFN resolutions, shared with edmProvDump.  Entries are invalidated by any change to the catalog or to the site's site-local-config.xml or storage.xml.  Defaults to $EDM_LFN_CACHE if that is set.")
+    ("refreshLfnCache", "Resolve every LFN with the catalog again and replace its --lfnCache entry.")
     ("uuid,u", "Print uuid")
     ("adler32,a", "Print adler32 checksum.")
+    ("crc32c", "Print CRC-32C checksum.  All selected checksums are computed in a single read of the file.")
+    ("sha256", "Print SHA-256 digest.  All selected checksums are computed in a single read of the file.")
+    ("checksumBuffers", boost::program_options::value<unsigned int>()->default_value(2U), "Number of read buffers used for the checksum.  With 2 or more the next buffer is read while the current one is checksummed.")
+    ("checksumBufferSize", boost::program_options::value<unsigned int>()->default_value(10U), "Size in MB of each checksum read buffer.")
+    ("checksumThreads", boost::program_options::value<unsigned int>()->default_value(1U), "Split each file into this many byte ranges, checksum them concurrently with independent reads, and combine the results into the whole file checksum.  Only used when adler32 is the only checksum selected.")
+    ("localRead", boost::program_options::value<std::string>(), "Read local files (file: or plain paths) for the checksum directly, bypassing ROOT.  Either 'mmap' or 'direct' (O_DIRECT, which keeps the file out of the page cache).")
+    ("checksumOnly", "Only compute the checksums and size (implies -a if no other checksum is selected).  The file is not opened as an EDM file, so it need not be a valid one.")
+    ("cache", boost::program_options::value<std::string>(), "Cache file for checksums, uuid and entry counts.  Unchanged local files (same device, inode, size and modification time) found in the cache are not read again; remote files have their checksums cached by FileID.  Defaults to $EDMFILEUTIL_CACHE if that is set.")
+    ("no-cache", "Do not use a cache, even if $EDMFILEUTIL_CACHE is set.")
     ("allowRecovery", "Allow root to auto-recover corrupted files")
+    ("timing", "For every file print the wall and CPU time spent opening it, checking its trees and counting entries, checksumming it (with the throughput in MB/s) and making the detailed reports, and the bytes and read calls ROOT made for it (direct --localRead checksum reads are not included).  Also prints the time of the catalog lookup and, for -e and --eventsInLumis, of the dictionary setup, which are done once for all the files.  Only for the per file reports.")
+    ("allDictionaries", "Configure the plugin manager and load the dictionary of any class on demand, instead of only enabling the provenance dictionaries the event and index reports need.  Much slower to start.")
+    ("fastOpen", "Check for the expected trees and read the run, lumi and event counts from the file's key directory and the first bytes of each tree, without building the trees and their branches.  Much faster for files with many branches.")
+    ("jobs", boost::program_options::value<unsigned int>()->default_value(1U), "Number of files to open and check concurrently.  Output is still printed in input order.  With more than one job a failing file does not stop the others; the exit code is nonzero if any file failed.")
     ("JSON,j", "JSON output format.  Any arguments listed below are ignored")
+    ("NDJSON", "Newline delimited JSON output: one self-contained record per line, tagged with a \"record\" member (file, entry, fastCopy, eventsInLumi, branch, branchDetails, branchStats, timing, catalogTiming or error) and the file name.  Unlike -j, -e, --eventsInLumis, -P, -b, --branchStats and -t are honoured; -l and -v are still ignored.")
     ("ls,l", "list file content")
     ("print,P", "Print all")
     ("verbose,v", "Verbose printout")
     ("printBranchDetails,b", "Call Print()sc for all branches")
-    ("tree,t", boost::program_options::value<std::string>(), "Select tree used with -P and -b options")
+    ("branchStats", "Print compressed and uncompressed size, compression ratio, basket count and sizes, entries per basket and fraction of the file for each top level branch")
+    ("sortBy", boost::program_options::value<std::string>()->default_value("zipBytes"), "Column to sort --branchStats by: branch, zipBytes, totBytes, ratio, baskets, minBasket, medianBasket, maxBasket, entriesPerBasket or fraction")
+    ("tree,t", boost::program_options::value<std::string>(), "Select tree used with -P, -b and --branchStats options")
     ("events,e", "Print list of all Events, Runs, and LuminosityBlocks in the file sorted by run number, luminosity block number, and event number.  Also prints the entry numbers and whether it is possible to use fast copy with the file.")
-    ("eventsInLumis","Print how many Events are in each LuminosityBlock.");
-
-  // What trees do we require for this to be a valid collection?
-  std::vector<std::string> expectedTrees;
-  expectedTrees.push_back(edm::poolNames::metaDataTreeName());
-  expectedTrees.push_back(edm::poolNames::eventTreeName());
+    ("eventsInLumis","Print how many Events are in each LuminosityBlock.")
+    ("dataset", "Read only the run/lumi index of every input file (use -F for long lists, and --jobs to read them concurrently) and print one merged table of events and files per LuminosityBlock for the whole dataset, flagging lumis split across files.  With -j or --NDJSON one record is printed per lumi.")
+    ("merge-plan", "Compare the file format versions, Events branches, compression and basket settings, process histories and event ordering of the input files, and report which of them a merge would fast clone together, and why the others would not be fast cloned.  With -j or --NDJSON one record per group.")
+    ("merge-groups", boost::program_options::value<unsigned int>(), "Pack the input files into merge groups of about this many MB each, keeping run/lumi order, never splitting a lumi and never mixing files which could not be fast cloned together, and print the file list of each group")
+    ("merge-groups-prefix", boost::program_options::value<std::string>(), "Also write the file list of each --merge-groups group to <prefix><group>.txt, ready for a PoolSource")
+    ("duplicates", "Report every run:lumi:event stored more than once in the input files, with the file and entry of each copy.  The exit code is nonzero if any is found.")
+    ("memoryBudget", boost::program_options::value<unsigned int>()->default_value(1024U), "MB of event locations --duplicates keeps in memory before spilling to disk")
+    ("spillDir", boost::program_options::value<std::string>(), "Directory for the --duplicates spill files.  Defaults to $TMPDIR, or /tmp.")
+    ("verify", "Read and decompress every basket of every branch of every tree, without streaming any object, and check each against the sizes recorded in its branch.  Reports the branch, entry range and file offset of each bad basket.  The branches of each file are shared among --jobs threads.")
+    ("build-index", boost::program_options::value<std::string>(), "Write a sorted, memory mappable index of the run, lumi, event, file and entry of every event in the input files to this file, for use with --lookup")
+    ("lookup", boost::program_options::value<std::string>(), "Answer the --query arguments from this index written by --build-index, without opening any data file.  Prints run:lumi:event, file and entry for each match; with -j or --NDJSON one record per match.  The exit code is nonzero if any query matched nothing.")
+    ("pick", boost::program_options::value<std::string>(), "Find the events listed in this file, one run:lumi:event per line, in the input files.  Prints the PFN of each file holding some of them, followed by their entries in increasing order; with -j or --NDJSON one record per event.  Only the events of listed lumis have their event number read.  The exit code is nonzero if any event is not found.")
+    ("serve", boost::program_options::value<std::string>(), "Keep the plugins, dictionaries and services loaded and answer requests from edmFileUtilClient on this Unix domain socket, --jobs at a time, until SIGINT, SIGTERM or a shutdown request.  The format and checksum options given here apply to every request.")
+    ("query", boost::program_options::value<std::vector<std::string> >(), "Event query for --lookup: run, run:lumi or run:lumi:event, or an inclusive range of two of those separated by '-'.  May be given several times.");
 
   boost::program_options::positional_options_description p;
   p.add("file", -1);
@@ -81,10 +1417,10 @@ int main(int argc, char* argv[]) {
 
   int rc = 0;
   try {
-    std::auto_ptr<edm::SiteLocalConfig> slcptr(new edm::service::SiteLocalConfigService(edm::ParameterSet()));
-    boost::shared_ptr<edm::serviceregistry::ServiceWrapper<edm::SiteLocalConfig> > slc(new edm::serviceregistry::ServiceWrapper<edm::SiteLocalConfig>(slcptr));
-    edm::ServiceToken slcToken = edm::ServiceRegistry::createContaining(slc);
-    edm::ServiceRegistry::Operate operate(slcToken);
+    if (vm.count("lookup")) {
+      std::vector<std::string> queries = (vm.count("query") ? vm["query"].as<std::vector<std::string> >() : std::vector<std::string>());
+      return lookupEvents(vm["lookup"].as<std::string>(), queries, vm.count("JSON") || vm.count("NDJSON"));
+    }
 
     std::vector<std::string> in = (vm.count("file") ? vm["file"].as<std::vector<std::string> >() : std::vector<std::string>());
     if (vm.count("Files")) {
@@ -97,203 +1433,290 @@ int main(int argc, char* argv[]) {
       std::istream_iterator<std::string> endItr;
       copy(beginItr, endItr, back_inserter(in));
     }
-    if (in.empty()) {
+    std::string const servePath = (vm.count("serve") ? vm["serve"].as<std::string>() : std::string());
+    if (in.empty() && servePath.empty()) {
       std::cout << "Data file(s) not set.\n";
       std::cout << desc << "\n";
       return 1;
     }
     std::string catalogIn = (vm.count("catalog") ? vm["catalog"].as<std::string>() : std::string());
-    bool decodeLFN = vm.count("decodeLFN");
-    bool uuid = vm.count("uuid");
-    bool adler32 = vm.count("adler32");
-    bool allowRecovery = vm.count("allowRecovery");
-    bool json = vm.count("JSON");
-    bool more = !json;
-    bool verbose = more && (vm.count("verbose") > 0 ? true : false);
-    bool events = more && (vm.count("events") > 0 ? true : false);
-    bool eventsInLumis = more && (vm.count("eventsInLumis") > 0 ? true : false);
-    bool ls = more && (vm.count("ls") > 0 ? true : false);
-    bool tree = more && (vm.count("tree") > 0 ? true : false);
-    bool print = more && (vm.count("print") > 0 ? true : false);
-    bool printBranchDetails = more && (vm.count("printBranchDetails") > 0 ? true : false);
-    bool onlyDecodeLFN = decodeLFN && !(uuid || adler32 || allowRecovery || json || events || tree || ls || print || printBranchDetails);
-    std::string selectedTree = tree ? vm["tree"].as<std::string>() : edm::poolNames::eventTreeName().c_str();
-
-    if (events||eventsInLumis) {
-      try {
-        edmplugin::PluginManager::configure(edmplugin::standard::config());
-      } catch(std::exception& e) {
-        std::cout << "exception caught in EdmFileUtil while configuring the PluginManager\n" << e.what();
+    unsigned int jobs = std::max(vm["jobs"].as<unsigned int>(), 1U);
+
+    FileUtilOptions opt;
+    // What trees do we require for this to be a valid collection?
+    opt.expectedTrees.push_back(edm::poolNames::metaDataTreeName());
+    opt.expectedTrees.push_back(edm::poolNames::eventTreeName());
+    opt.decodeLFN = vm.count("decodeLFN");
+    opt.uuid = vm.count("uuid");
+    opt.digests.adler32 = vm.count("adler32");
+    opt.digests.crc32c = vm.count("crc32c");
+    opt.digests.sha256 = vm.count("sha256");
+    opt.checksumBuffers = vm["checksumBuffers"].as<unsigned int>();
+    opt.checksumThreads = vm["checksumThreads"].as<unsigned int>();
+    opt.localRead = vm.count("localRead");
+    opt.localReadMode = edm::kMmapRead;
+    if (opt.localRead) {
+      std::string const mode = vm["localRead"].as<std::string>();
+      if (mode == "direct") {
+        opt.localReadMode = edm::kDirectRead;
+      } else if (mode != "mmap") {
+        std::cout << "--localRead must be 'mmap' or 'direct', not '" << mode << "'\n";
         return 1;
       }
-      edm::RootAutoLibraryLoader::enable();
     }
-
-    edm::InputFileCatalog catalog(in, catalogIn, true);
-    std::vector<std::string> const& filesIn = catalog.fileNames();
-
-    if (json) {
-      std::cout << '[' << std::endl;
+    std::string cachePath;
+    if (vm.count("cache")) {
+      cachePath = vm["cache"].as<std::string>();
+    } else if (char const* env = getenv("EDMFILEUTIL_CACHE")) {
+      cachePath = env;
     }
+    std::unique_ptr<edm::FileMetadataCache> cache;
+    if (!cachePath.empty() && !vm.count("no-cache")) {
+      cache.reset(new edm::FileMetadataCache(cachePath));
+    }
+    opt.cache = cache.get();
+    opt.checksumOnly = vm.count("checksumOnly");
+    if (opt.checksumOnly && !opt.digests.any()) opt.digests.adler32 = true;
+    // TFile::ReadBuffer takes an Int_t length, so keep each buffer well below 2GB.
+    opt.checksumBufferSize = std::min(std::max(vm["checksumBufferSize"].as<unsigned int>(), 1U), 1024U) * 1024 * 1024;
+    opt.allowRecovery = vm.count("allowRecovery");
+    opt.fastOpen = vm.count("fastOpen") > 0;
+    opt.timing = vm.count("timing") > 0;
+    opt.ndjson = vm.count("NDJSON");
+    opt.json = opt.ndjson || vm.count("JSON");
+    bool more = (!opt.json || opt.ndjson) && !opt.checksumOnly;
+    bool text = !opt.json && !opt.checksumOnly;
+    opt.verbose = text && (vm.count("verbose") > 0 ? true : false);
+    opt.events = more && (vm.count("events") > 0 ? true : false);
+    opt.eventsInLumis = more && (vm.count("eventsInLumis") > 0 ? true : false);
+    opt.dataset = !opt.checksumOnly && vm.count("dataset") > 0;
+    std::string const indexPath = (vm.count("build-index") ? vm["build-index"].as<std::string>() : std::string());
+    std::string const pickPath = (vm.count("pick") ? vm["pick"].as<std::string>() : std::string());
+    bool const mergePlan = vm.count("merge-plan") > 0;
+    bool const mergeGroups = vm.count("merge-groups") > 0;
+    bool const duplicates = vm.count("duplicates") > 0;
+    bool const verify = vm.count("verify") > 0;
+    opt.ls = text && (vm.count("ls") > 0 ? true : false);
+    bool tree = more && (vm.count("tree") > 0 ? true : false);
+    opt.print = more && (vm.count("print") > 0 ? true : false);
+    opt.printBranchDetails = more && (vm.count("printBranchDetails") > 0 ? true : false);
+    opt.branchStats = more && (vm.count("branchStats") > 0 ? true : false);
+    opt.branchStatsSortBy = vm["sortBy"].as<std::string>();
+    if (opt.branchStats && !edm::isBranchStatsColumn(opt.branchStatsSortBy)) {
+      std::cout << "Unknown --sortBy column '" << opt.branchStatsSortBy << "'\n";
+      return 1;
+    }
+    bool onlyDecodeLFN = opt.decodeLFN && !(opt.uuid || opt.digests.any() || opt.allowRecovery || opt.json || opt.events || tree || opt.ls || opt.print || opt.printBranchDetails || opt.branchStats || opt.dataset || !indexPath.empty() || !pickPath.empty() || mergePlan || mergeGroups || duplicates || verify || !servePath.empty());
+    opt.selectedTree = tree ? vm["tree"].as<std::string>() : edm::poolNames::eventTreeName().c_str();
 
-    // now run..
-    // Allow user to input multiple files
-    for(unsigned int j = 0; j < in.size(); ++j) {
-
-      // We _only_ want the LFN->PFN conversion. No need to open the file,
-      // just check the catalog and move on
-      if (onlyDecodeLFN) {
-        std::cout << filesIn[j] << std::endl;
-        continue;
+    bool const allDictionaries = vm.count("allDictionaries") > 0;
+    bool const needDictionaries = opt.events||opt.eventsInLumis||opt.dataset||!indexPath.empty()||!pickPath.empty()||mergePlan||mergeGroups||duplicates||!servePath.empty();
+    PhaseTime dictionaryTime;
+    if (needDictionaries) {
+      PhaseTimer timer(dictionaryTime);
+      if (allDictionaries) {
+        try {
+          edmplugin::PluginManager::configure(edmplugin::standard::config());
+        } catch(std::exception& e) {
+          std::cout << "exception caught in EdmFileUtil while configuring the PluginManager\n" << e.what();
+          return 1;
+        }
+        edm::RootAutoLibraryLoader::enable();
+      } else {
+        // Every class these modes read (IndexIntoFile, FileIndex,
+        // EventAuxiliary, FileFormatVersion, FileID, ProcessHistory) is in
+        // DataFormats/Provenance, which is linked in, so its dictionaries
+        // only need to be made visible to ROOT.  The plugin cache is never
+        // read.
+        ROOT::Cintex::Cintex::Enable();
       }
+    }
+    if (needDictionaries && opt.verbose) {
+      std::cout << "ECU:: Dictionaries set up in " << dictionaryTime.wall << " s\n";
+    }
 
-      // open a data file
-      if (!json) std::cout << in[j] << "\n";
-      std::string const& lfn = in[j];
-      TFile *tfile = edm::openFileHdl(filesIn[j]);
-      if (tfile == 0) return 1;
+    std::string const lfnCachePath = (vm.count("lfnCache") ? vm["lfnCache"].as<std::string>() : edm::LfnResolver::defaultCachePath());
+    edm::LfnResolver resolver(lfnCachePath, catalogIn, vm.count("refreshLfnCache") > 0);
+    PhaseTime catalogTime;
+    std::vector<std::string> filesIn;
+    {
+      PhaseTimer timer(catalogTime);
+      filesIn = resolver.resolve(in);
+    }
 
-      std::string const& pfn = filesIn[j];
+    // Files are read from helper threads even with a single job (for
+    // example by the pipelined checksum), so always let ROOT know.
+    TThread::Initialize();
 
-      if (verbose) std::cout << "ECU:: Opened " << pfn << std::endl;
+    // We _only_ want the LFN->PFN conversion. No need to open the file,
+    // just check the catalog and move on
+    if (onlyDecodeLFN) {
+      return printDecodedLFNs(jobs, in, filesIn, vm.count("checkExists") > 0);
+    }
 
-      std::string datafile = decodeLFN ? pfn : lfn;
+    std::auto_ptr<edm::SiteLocalConfig> slcptr(new edm::service::SiteLocalConfigService(edm::ParameterSet()));
+    boost::shared_ptr<edm::serviceregistry::ServiceWrapper<edm::SiteLocalConfig> > slc(new edm::serviceregistry::ServiceWrapper<edm::SiteLocalConfig>(slcptr));
+    edm::ServiceToken slcToken = edm::ServiceRegistry::createContaining(slc);
+    edm::ServiceRegistry::Operate operate(slcToken);
 
-      // First check that this file is not auto-recovered
-      // Stop the job unless specified to do otherwise
+    if (!servePath.empty()) {
+      return serveQueries(opt, jobs, servePath, resolver, slcToken);
+    }
+    if (opt.dataset) {
+      return summarizeDataset(opt, jobs, in, filesIn, slcToken);
+    }
+    if (!indexPath.empty()) {
+      return buildEventIndex(opt, jobs, in, filesIn, slcToken, indexPath);
+    }
+    if (!pickPath.empty()) {
+      return pickEvents(opt, jobs, in, filesIn, slcToken, pickPath);
+    }
+    if (mergePlan) {
+      return printMergePlan(opt, jobs, in, filesIn, slcToken);
+    }
+    if (verify) {
+      return verifyFiles(opt, jobs, in, filesIn);
+    }
+    if (duplicates) {
+      std::string spillDir = "/tmp";
+      if (vm.count("spillDir")) {
+        spillDir = vm["spillDir"].as<std::string>();
+      } else if (char const* tmp = getenv("TMPDIR")) {
+        spillDir = tmp;
+      }
+      return findDuplicates(opt, jobs, in, filesIn, slcToken,
+                            size_t(vm["memoryBudget"].as<unsigned int>()) * 1024 * 1024, spillDir);
+    }
+    if (mergeGroups) {
+      return printMergeGroups(opt, jobs, in, filesIn, slcToken,
+                              vm["merge-groups"].as<unsigned int>() * 1024ULL * 1024ULL,
+                              vm.count("merge-groups-prefix") ? vm["merge-groups-prefix"].as<std::string>() : std::string());
+    }
 
-      bool isRecovered = tfile->TestBit(TFile::kRecovered);
-      if (isRecovered) {
-        if (allowRecovery) {
-          if (!json) {
-            std::cout << pfn << " appears not to have been closed correctly and has been autorecovered \n";
-            std::cout << "Proceeding anyway\n";
-          }
-        } else {
-          std::cout << pfn << " appears not to have been closed correctly and has been autorecovered \n";
-          std::cout << "Stopping. Use --allowRecovery to try ignoring this\n";
-          return 1;
-        }
+    if (opt.timing) {
+      if (opt.ndjson) {
+        std::cout << "{\"record\":\"catalogTiming\",\"file\":\"\",\"files\":" << in.size()
+                  << ",\"wall\":" << catalogTime.wall << ",\"cpu\":" << catalogTime.cpu << "}\n";
       } else {
-        if (verbose) std::cout << "ECU:: Collection not autorecovered. Continuing\n";
+        // Not part of the -j array, which only holds file records.
+        (opt.json ? std::cerr : std::cout) << "Catalog lookup of " << in.size() << " files: "
+                                           << catalogTime.wall << " s wall, " << catalogTime.cpu << " s cpu\n";
       }
-
-      // Ok. Do we have the expected trees?
-      for (unsigned int i = 0; i < expectedTrees.size(); ++i) {
-        TTree *t = (TTree*) tfile->Get(expectedTrees[i].c_str());
-        if (t == 0) {
-          std::cout << "Tree " << expectedTrees[i] << " appears to be missing. Not a valid collection\n";
-          std::cout << "Exiting\n";
-          return 1;
+      if (needDictionaries) {
+        if (opt.ndjson) {
+          std::cout << "{\"record\":\"dictionaryTiming\",\"file\":\"\",\"allDictionaries\":" << (allDictionaries ? "true" : "false")
+                    << ",\"wall\":" << dictionaryTime.wall << ",\"cpu\":" << dictionaryTime.cpu << "}\n";
         } else {
-          if (verbose) std::cout << "ECU:: Found Tree " << expectedTrees[i] << std::endl;
+          (opt.json ? std::cerr : std::cout) << "Dictionary setup (" << (allDictionaries ? "all dictionaries" : "Cintex only") << "): "
+                                             << dictionaryTime.wall << " s wall, " << dictionaryTime.cpu << " s cpu\n";
         }
       }
+    }
 
-      if (verbose) std::cout << "ECU:: Found all expected trees\n";
-
-      std::ostringstream auout;
-      if (adler32) {
-        unsigned int const EDMFILEUTILADLERBUFSIZE = 10*1024*1024; // 10MB buffer
-        static char buffer[EDMFILEUTILADLERBUFSIZE];
-        size_t bufToRead = EDMFILEUTILADLERBUFSIZE;
-        uint32_t a = 1, b = 0;
-        size_t fileSize = tfile->GetSize();
-        tfile->Seek(0, TFile::kBeg);
+    if (opt.json && !opt.ndjson) {
+      std::cout << '[' << std::endl;
+    }
 
-        for (size_t offset = 0; offset < fileSize;
-              offset += EDMFILEUTILADLERBUFSIZE) {
-            // true on last loop
-            if (fileSize - offset < EDMFILEUTILADLERBUFSIZE)
-              bufToRead = fileSize - offset;
-            tfile->ReadBuffer((char*)buffer, bufToRead);
-            cms::Adler32(buffer, bufToRead, a, b);
+    // now run..
+    // Allow user to input multiple files.  Files are opened and summarized
+    // on up to 'jobs' threads; the results are printed here in input order.
+    // With a single job the first failure stops the loop, as it always has.
+    bool const details = opt.ls || opt.print || opt.printBranchDetails || opt.branchStats || opt.events || opt.eventsInLumis;
+    std::vector<FileReport> reports(in.size());
+    std::atomic<bool> stop(false);
+    bool firstRecord = true;
+    unsigned int nFailed = 0;
+    edm::orderedParallelFor(in.size(), jobs, details ? 2 * jobs : 0,
+      [&](unsigned int j) {
+        if (stop) return;
+        edm::ServiceRegistry::Operate workerOperate(slcToken);
+        try {
+          if (opt.checksumOnly) {
+            checksumFile(opt, in[j], filesIn[j], reports[j]);
+          } else {
+            summarizeFile(opt, in[j], filesIn[j], reports[j]);
+          }
+        } catch (cms::Exception const& e) {
+          if (jobs == 1) throw;
+          reports[j].rc = 1;
+          reports[j].error = e.explainSelf();
+        } catch (std::exception const& e) {
+          if (jobs == 1) throw;
+          reports[j].rc = 1;
+          reports[j].error = e.what();
         }
-        uint32_t adler32sum = (b << 16) | a;
-        if (json) {
-          auout << ",\"adler32sum\":" << adler32sum;
-        } else {
-          auout << ", " << std::hex << adler32sum << " adler32sum";
+      },
+      [&](unsigned int j) {
+        FileReport& report = reports[j];
+        if (stop) {
+          if (report.tfile != 0) {
+            report.tfile->Close();
+            delete report.tfile;
+            report.tfile = 0;
+          }
+          return;
         }
-      }
-
-      if (uuid) {
-        TTree *paramsTree = (TTree*)tfile->Get(edm::poolNames::metaDataTreeName().c_str());
-        if (json) {
-          auout << ",\"uuid\":\"" << edm::getUuid(paramsTree) << '"';
+        std::string const datafile = opt.decodeLFN ? filesIn[j] : in[j];
+        if (opt.json) {
+          if ((report.rc == 0 || jobs > 1) && !opt.ndjson) {
+            if (!firstRecord) std::cout << ',' << std::endl;
+            firstRecord = false;
+          }
+          if (report.rc == 0) {
+            std::cout << report.text;
+            // Warnings, such as missing trees, which would break the JSON.
+            std::cerr << report.error;
+          } else if (jobs > 1 || opt.ndjson) {
+            std::cout << '{' << (opt.ndjson ? "\"record\":\"error\"," : "")
+                      << "\"file\":\"" << edm::jsonEscape(datafile) << '"'
+                      << ",\"error\":\"" << edm::jsonEscape(report.error) << "\"}" << std::endl;
+          } else {
+            std::cout << report.error;
+          }
         } else {
-          auout << ", " << edm::getUuid(paramsTree) << " uuid";
-        }
-      }
-
-      // Ok. How many events?
-      int nruns = edm::numEntries(tfile, edm::poolNames::runTreeName());
-      int nlumis = edm::numEntries(tfile, edm::poolNames::luminosityBlockTreeName());
-      int nevents = edm::numEntries(tfile, edm::poolNames::eventTreeName());
-      if (json) {
-        if (j > 0) std::cout << ',' << std::endl;
-        std::cout << "{\"file\":\"" << datafile << '"'
-                  << ",\"runs\":" << nruns
-                  << ",\"lumis\":" << nlumis
-                  << ",\"events\":" << nevents
-                  << ",\"bytes\":" << tfile->GetSize()
-                  << auout.str()
-                  << '}' << std::endl;
-      } else {
-        std::cout << datafile << " ("
-                  << nruns << " runs, "
-                  << nlumis << " lumis, "
-                  << nevents << " events, "
-                  << tfile->GetSize() << " bytes"
-                  << auout.str()
-                  << ")" << std::endl;
-      }
-
-      if (json) {
-        // Remainder of arguments not supported in JSON yet.
-        continue;
-      }
-
-      // Look at the collection contents
-      if (ls) {
-        if (tfile != 0) tfile->ls();
-      }
-
-      // Print out each tree
-      if (print) {
-        TTree *printTree = (TTree*)tfile->Get(selectedTree.c_str());
-        if (printTree == 0) {
-          std::cout << "Tree " << selectedTree << " appears to be missing. Could not find it in the file.\n";
-          std::cout << "Exiting\n";
-          return 1;
+          std::cout << report.text << report.error;
         }
-        edm::printBranchNames(printTree);
-      }
-
-      if (printBranchDetails) {
-        TTree *printTree = (TTree*)tfile->Get(selectedTree.c_str());
-        if (printTree == 0) {
-          std::cout << "Tree " << selectedTree << " appears to be missing. Could not find it in the file.\n";
-          std::cout << "Exiting\n";
-          return 1;
+        if (report.rc == 0 && details) {
+          PhaseTimer timer(report.timing.details);
+          report.rc = printFileDetails(opt, datafile, report.tfile, std::cout);
         }
-        edm::longBranchPrint(printTree);
-      }
-
-      // Print out event lists
-      if (events) {
-        edm::printEventLists(tfile);
-      }
+        if (opt.timing && report.tfile != 0) {
+          report.timing.bytesRead = report.tfile->GetBytesRead();
+          report.timing.readCalls = report.tfile->GetReadCalls();
+        }
+        if (report.recordOpen) {
+          closeRecord(report, std::cout);
+        } else if (opt.timing && report.rc == 0) {
+          if (opt.ndjson) {
+            std::cout << "{\"record\":\"timing\",\"file\":\"" << edm::jsonEscape(datafile) << "\",";
+            printTiming(report.timing, true, std::cout);
+            std::cout << "}\n";
+          } else {
+            printTiming(report.timing, false, std::cout);
+          }
+        }
+        if (report.tfile != 0) {
+          report.tfile->Close();
+          delete report.tfile;
+          report.tfile = 0;
+        }
+        if (report.rc != 0) {
+          ++nFailed;
+          if (jobs == 1) stop = true;
+        }
+        report.text.clear();
+      });
 
-      if(eventsInLumis) {
-        edm::printEventsInLumis(tfile);
-      }
-      
-      tfile->Close();
+    if (jobs == 1 && nFailed != 0) {
+      return 1;
     }
-    if (json) {
+    if (opt.json && !opt.ndjson) {
       std::cout << ']' << std::endl;
     }
+    if (nFailed != 0) {
+      std::cerr << nFailed << " of " << in.size() << " files failed\n";
+      rc = 1;
+    }
   }
   catch (cms::Exception const& e) {
     std::cout << "cms::Exception caught in "
@@ -0,0 +1,100 @@
+//----------------------------------------------------------------------
+// EdmFileUtilClient.cpp
+//
+// Asks an 'edmFileUtil --serve' server for reports on files, so that each
+// query does not pay for loading plugins, dictionaries and services.
+//
+
+#include "IOPool/Common/bin/QueryServer.h"
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <boost/program_options.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+
+  boost::program_options::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "print help message")
+    ("file,f", boost::program_options::value<std::vector<std::string> >(), "data file (-f or -F required, unless --shutdown)")
+    ("Files,F", boost::program_options::value<std::string>(), "text file containing names of data files, one per line")
+    ("socket,s", boost::program_options::value<std::string>(), "Unix domain socket of the server.  Defaults to $EDMFILEUTIL_SOCKET.")
+    ("report,r", boost::program_options::value<std::string>()->default_value("summary"), "Report to ask for: summary, decodeLFN, events, eventsInLumis, print or branchStats")
+    ("shutdown", "Ask the server to stop");
+
+  boost::program_options::positional_options_description p;
+  p.add("file", -1);
+
+  boost::program_options::variables_map vm;
+  try {
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).
+                                  options(desc).positional(p).run(), vm);
+  } catch (boost::program_options::error const& x) {
+    std::cerr << "Option parsing failure:\n"
+              << x.what() << "\n\n";
+    std::cerr << desc << "\n";
+    return 1;
+  }
+  boost::program_options::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << "\n";
+    return 1;
+  }
+
+  std::string socketPath;
+  if (vm.count("socket")) {
+    socketPath = vm["socket"].as<std::string>();
+  } else if (char const* env = getenv("EDMFILEUTIL_SOCKET")) {
+    socketPath = env;
+  }
+  if (socketPath.empty()) {
+    std::cerr << "Server socket not set.\n";
+    return 1;
+  }
+
+  int rc = 0;
+  try {
+    std::string output;
+    if (vm.count("shutdown")) {
+      return edm::sendQuery(socketPath, "shutdown", std::string(), output) ? 0 : 1;
+    }
+
+    std::vector<std::string> in = (vm.count("file") ? vm["file"].as<std::vector<std::string> >() : std::vector<std::string>());
+    if (vm.count("Files")) {
+      std::ifstream ifile(vm["Files"].as<std::string>().c_str());
+      std::istream_iterator<std::string> beginItr(ifile);
+      if (ifile.fail()) {
+        std::cerr << "File '" << vm["Files"].as<std::string>() << "' not found, not opened, or empty\n";
+        return 1;
+      }
+      std::istream_iterator<std::string> endItr;
+      copy(beginItr, endItr, back_inserter(in));
+    }
+    if (in.empty()) {
+      std::cerr << "Data file(s) not set.\n";
+      return 1;
+    }
+
+    std::string const report = vm["report"].as<std::string>();
+    for (std::vector<std::string>::const_iterator it = in.begin(), itEnd = in.end(); it != itEnd; ++it) {
+      if (edm::sendQuery(socketPath, report, *it, output)) {
+        std::cout << output;
+      } else {
+        std::cerr << output;
+        rc = 1;
+      }
+    }
+  }
+  catch (cms::Exception const& e) {
+    std::cerr << e.explainSelf();
+    rc = 1;
+  }
+  return rc;
+}
@@ -1,3 +1,4 @@
+#include "IOPool/Common/bin/LfnResolver.h"
 #include "DataFormats/Provenance/interface/BranchType.h"
 #include "DataFormats/Provenance/interface/EventSelectionID.h"
 #include "DataFormats/Provenance/interface/History.h"
@@ -11,12 +12,10 @@
 #include "DataFormats/Provenance/interface/ProductProvenance.h"
 #include "DataFormats/Provenance/interface/StoredProductProvenance.h"
 #include "DataFormats/Provenance/interface/ParentageRegistry.h"
-#include "FWCore/Catalog/interface/InputFileCatalog.h"
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
 #include "FWCore/ParameterSet/interface/Registry.h"
 #include "FWCore/ParameterSet/interface/FillProductRegistryTransients.h"
 #include "FWCore/ServiceRegistry/interface/ServiceRegistry.h"
-#include "FWCore/Services/src/SiteLocalConfigService.h"
 
 #include "FWCore/Utilities/interface/Algorithms.h"
 #include "FWCore/Utilities/interface/Exception.h"
@@ -381,21 +380,18 @@ void HistoryNode::printTopLevelPSetsHistory(ParameterSetMap const& iPSM,
 namespace {
   std::unique_ptr<TFile>
   makeTFileWithLookup(std::string const& filename) {
-    // See if it is a logical file name.
-    std::auto_ptr<edm::SiteLocalConfig> slcptr(new edm::service::SiteLocalConfigService(edm::ParameterSet()));
-    boost::shared_ptr<edm::serviceregistry::ServiceWrapper<edm::SiteLocalConfig> > slc(new edm::serviceregistry::ServiceWrapper<edm::SiteLocalConfig>(slcptr));
-    edm::ServiceToken slcToken = edm::ServiceRegistry::createContaining(slc);
-    edm::ServiceRegistry::Operate operate(slcToken);
-    std::string override;
+    // See if it is a logical file name.  Resolutions are shared with
+    // edmFileUtil through $EDM_LFN_CACHE, if that is set.
+    edm::LfnResolver resolver(edm::LfnResolver::defaultCachePath(), std::string());
     std::vector<std::string> fileNames;
     fileNames.push_back(filename);
-    edm::InputFileCatalog catalog(fileNames, override, true);
-    if(catalog.fileNames()[0] == filename) {
+    std::string const pfn = resolver.resolve(fileNames)[0];
+    if(pfn == filename) {
       throw cms::Exception("FileNotFound", "RootFile::RootFile()")
         << "File " << filename << " was not found or could not be opened.\n";
     }
     // filename is a valid LFN.
-    std::unique_ptr<TFile> result(TFile::Open(catalog.fileNames()[0].c_str()));
+    std::unique_ptr<TFile> result(TFile::Open(pfn.c_str()));
     if(!result.get()) {
       throw cms::Exception("FileNotFound", "RootFile::RootFile()")
         << "File " << fileNames[0] << " was not found or could not be opened.\n";
@@ -0,0 +1,184 @@
+#include "IOPool/Common/bin/EventIndexFile.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace edm {
+
+  namespace {
+    char const kMagic[8] = {'E', 'D', 'M', 'E', 'V', 'I', 'D', 'X'};
+    uint32_t const kVersion = 1;
+    uint32_t const kByteOrderMark = 0x01020304;
+
+    struct Header {
+      char magic[8];
+      uint32_t version;
+      uint32_t byteOrder;
+      uint64_t nRecords;
+      uint64_t recordsOffset;
+      uint64_t namesOffset;
+      uint32_t nFiles;
+      uint32_t recordSize;
+    };
+
+    // Only run, lumi and event take part.
+    bool eventLess(EventIndexRecord const& a, EventIndexRecord const& b) {
+      if(a.run != b.run) return a.run < b.run;
+      if(a.lumi != b.lumi) return a.lumi < b.lumi;
+      return a.event < b.event;
+    }
+
+    void writeFully(int fd, void const* data, size_t size, std::string const& path) {
+      char const* p = static_cast<char const*>(data);
+      while(size > 0) {
+        ssize_t n = write(fd, p, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+          throw cms::Exception("FileWriteError", "writeEventIndex")
+            << "Could not write event index " << path << ": " << strerror(errno) << "\n";
+        }
+        p += n;
+        size -= n;
+      }
+    }
+  }
+
+  bool operator<(EventIndexRecord const& a, EventIndexRecord const& b) {
+    if(eventLess(a, b)) return true;
+    if(eventLess(b, a)) return false;
+    if(a.file != b.file) return a.file < b.file;
+    return a.entry < b.entry;
+  }
+
+  void writeEventIndex(std::string const& path, std::vector<std::string> const& fileNames,
+                       std::vector<EventIndexRecord>& records) {
+    std::sort(records.begin(), records.end());
+
+    Header header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byteOrder = kByteOrderMark;
+    header.nRecords = records.size();
+    header.recordsOffset = sizeof(Header);
+    header.namesOffset = header.recordsOffset + records.size() * sizeof(EventIndexRecord);
+    header.nFiles = fileNames.size();
+    header.recordSize = sizeof(EventIndexRecord);
+
+    std::string const tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+      throw cms::Exception("FileOpenError", "writeEventIndex")
+        << "Could not create event index " << tmpPath << ": " << strerror(errno) << "\n";
+    }
+    try {
+      writeFully(fd, &header, sizeof(header), tmpPath);
+      if(!records.empty()) {
+        writeFully(fd, &records[0], records.size() * sizeof(EventIndexRecord), tmpPath);
+      }
+      for(std::vector<std::string>::const_iterator it = fileNames.begin(), itEnd = fileNames.end(); it != itEnd; ++it) {
+        uint32_t length = it->size();
+        writeFully(fd, &length, sizeof(length), tmpPath);
+        writeFully(fd, it->data(), it->size(), tmpPath);
+      }
+    } catch(...) {
+      close(fd);
+      unlink(tmpPath.c_str());
+      throw;
+    }
+    if(close(fd) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+      unlink(tmpPath.c_str());
+      throw cms::Exception("FileWriteError", "writeEventIndex")
+        << "Could not write event index " << path << ": " << strerror(errno) << "\n";
+    }
+  }
+
+  EventIndexFile::EventIndexFile(std::string const& path) :
+    path_(path),
+    map_(MAP_FAILED),
+    mapSize_(0),
+    records_(0),
+    nRecords_(0),
+    fileNames_() {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+      throw cms::Exception("FileOpenError", "EventIndexFile")
+        << "Could not open event index " << path << ": " << strerror(errno) << "\n";
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+      mapSize_ = st.st_size;
+      map_ = mmap(0, mapSize_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(map_ == MAP_FAILED) {
+      throw cms::Exception("FileReadError", "EventIndexFile")
+        << "Could not map event index " << path << "\n";
+    }
+
+    char const* base = static_cast<char const*>(map_);
+    Header header;
+    bool valid = mapSize_ >= sizeof(Header);
+    if(valid) {
+      memcpy(&header, base, sizeof(header));
+      valid = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+              header.version == kVersion &&
+              header.byteOrder == kByteOrderMark &&
+              header.recordSize == sizeof(EventIndexRecord) &&
+              header.recordsOffset % 8 == 0 &&
+              header.recordsOffset <= mapSize_ &&
+              header.nRecords <= (mapSize_ - header.recordsOffset) / sizeof(EventIndexRecord) &&
+              header.namesOffset == header.recordsOffset + header.nRecords * sizeof(EventIndexRecord);
+    }
+    uint64_t offset = valid ? header.namesOffset : 0;
+    for(uint32_t i = 0; valid && i < header.nFiles; ++i) {
+      uint32_t length;
+      valid = offset + sizeof(length) <= mapSize_;
+      if(!valid) break;
+      memcpy(&length, base + offset, sizeof(length));
+      offset += sizeof(length);
+      valid = offset + length <= mapSize_;
+      if(!valid) break;
+      fileNames_.push_back(std::string(base + offset, length));
+      offset += length;
+    }
+    if(!valid) {
+      munmap(map_, mapSize_);
+      throw cms::Exception("FileReadError", "EventIndexFile")
+        << path << " is not an event index, or was written on a machine with a different byte order\n";
+    }
+    records_ = reinterpret_cast<EventIndexRecord const*>(base + header.recordsOffset);
+    nRecords_ = header.nRecords;
+    madvise(map_, mapSize_, MADV_RANDOM);
+  }
+
+  EventIndexFile::~EventIndexFile() {
+    munmap(map_, mapSize_);
+  }
+
+  // Checked per lookup rather than when mapping, which would read every
+  // record of the index.
+  std::string const& EventIndexFile::fileName(EventIndexRecord const& record) const {
+    if(record.file >= fileNames_.size()) {
+      throw cms::Exception("FileReadError", "EventIndexFile")
+        << "Event index " << path_ << " is corrupt: a record for " << record.run << ':' << record.lumi << ':' << record.event
+        << " refers to file " << record.file << " of " << fileNames_.size() << "\n";
+    }
+    return fileNames_[record.file];
+  }
+
+  std::pair<EventIndexFile::const_iterator, EventIndexFile::const_iterator>
+  EventIndexFile::range(EventIndexRecord const& first, EventIndexRecord const& last) const {
+    const_iterator lo = std::lower_bound(begin(), end(), first, eventLess);
+    const_iterator hi = std::upper_bound(lo, end(), last, eventLess);
+    return std::make_pair(lo, hi);
+  }
+}
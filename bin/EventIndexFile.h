@@ -0,0 +1,72 @@
+#ifndef IOPool_Common_EventIndexFile_h
+#define IOPool_Common_EventIndexFile_h
+
+// A sidecar index telling which file and entry hold each event of a set
+// of files, built once with ROOT and then searched without it.
+//
+// The file is written in native byte order and is meant to be mmapped:
+//   Header        (fixed size, see below)
+//   Record[n]     sorted by run, lumi, event, file, entry
+//   file names    n times: uint32 length, then the bytes of the name
+// A lookup is a binary search over the mmapped record array, so it costs
+// a few page faults whatever the size of the dataset.
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace edm {
+
+  struct EventIndexRecord {
+    uint32_t run;
+    uint32_t lumi;
+    uint64_t event;
+    uint64_t entry;  // in the Events tree
+    uint32_t file;   // ordinal in the file name table
+    uint32_t unused; // keeps the records 8 byte aligned
+  };
+
+  // Orders records by run, lumi and event, then by file and entry.
+  bool operator<(EventIndexRecord const& a, EventIndexRecord const& b);
+
+  // Sorts 'records' and writes them with 'fileNames' to 'path', replacing
+  // it atomically.  Throws if the file cannot be written.
+  void writeEventIndex(std::string const& path, std::vector<std::string> const& fileNames,
+                       std::vector<EventIndexRecord>& records);
+
+  class EventIndexFile {
+  public:
+    typedef EventIndexRecord const* const_iterator;
+
+    // Maps 'path'.  Throws if it is not a valid index written on a machine
+    // with the same byte order.
+    explicit EventIndexFile(std::string const& path);
+    ~EventIndexFile();
+
+    EventIndexFile(EventIndexFile const&) = delete;
+    EventIndexFile& operator=(EventIndexFile const&) = delete;
+
+    const_iterator begin() const { return records_; }
+    const_iterator end() const { return records_ + nRecords_; }
+    uint64_t size() const { return nRecords_; }
+    std::vector<std::string> const& fileNames() const { return fileNames_; }
+    // The name of the file holding 'record'.  Throws if the record names
+    // no file in the table, which only happens with a corrupt index.
+    std::string const& fileName(EventIndexRecord const& record) const;
+
+    // The records from run:lumi:event 'first' to 'last' inclusive.
+    // Only the run, lumi and event of the arguments are used.
+    std::pair<const_iterator, const_iterator> range(EventIndexRecord const& first, EventIndexRecord const& last) const;
+
+  private:
+    std::string path_;
+    void* map_;
+    size_t mapSize_;
+    EventIndexRecord const* records_;
+    uint64_t nRecords_;
+    std::vector<std::string> fileNames_;
+  };
+}
+
+#endif
@@ -0,0 +1,225 @@
+#include "IOPool/Common/bin/FileMetadataCache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace edm {
+
+  namespace {
+    char const* const kRecordVersion = "v1";
+
+    // Keys, file names and values are written unescaped, so they must not
+    // contain the separators.
+    bool writable(std::string const& s) {
+      return s.find_first_of("\t\n") == std::string::npos;
+    }
+
+    std::string formatRecord(std::string const& key, std::string const& fileName, FileMetadataCache::Record const& record) {
+      std::ostringstream line;
+      line << kRecordVersion << '\t' << key << '\t' << fileName;
+      for(FileMetadataCache::Record::const_iterator it = record.begin(), itEnd = record.end(); it != itEnd; ++it) {
+        line << '\t' << it->first << '=' << it->second;
+      }
+      line << '\n';
+      return line.str();
+    }
+
+    // Whether 'fd' is still the file called 'path'; a compaction may have
+    // renamed a new file over it since it was opened.
+    bool stillNamed(int fd, std::string const& path) {
+      struct stat byFd, byName;
+      return fstat(fd, &byFd) == 0 && stat(path.c_str(), &byName) == 0 &&
+             byFd.st_dev == byName.st_dev && byFd.st_ino == byName.st_ino;
+    }
+
+    // Appends 'text' to 'path' holding an exclusive lock, so that several
+    // processes sharing one cache do not interleave their records.
+    void appendLocked(std::string const& path, std::string const& text) {
+      for(int attempt = 0; attempt < 3; ++attempt) {
+        int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+        if(fd < 0) return; // The cache is only an optimization.
+        if(flock(fd, LOCK_EX) != 0) {
+          close(fd);
+          return;
+        }
+        // Appending to a file which was compacted away would lose the record.
+        if(!stillNamed(fd, path)) {
+          flock(fd, LOCK_UN);
+          close(fd);
+          continue;
+        }
+        size_t done = 0;
+        while(done < text.size()) {
+          ssize_t n = write(fd, text.data() + done, text.size() - done);
+          if(n <= 0) break;
+          done += n;
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+        return;
+      }
+    }
+
+    // Appends everything from 'offset' to the end of 'fd' to 'text'.
+    void readFrom(int fd, off_t offset, std::string& text) {
+      char buffer[65536];
+      for(;;) {
+        ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return;
+        text.append(buffer, n);
+        offset += n;
+      }
+    }
+  }
+
+  FileMetadataCache::FileMetadataCache(std::string const& path) :
+    path_(path),
+    records_(),
+    keyOfFile_(),
+    mutex_() {
+    load();
+  }
+
+  std::string FileMetadataCache::localFileKey(std::string const& path) {
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) return std::string();
+    std::ostringstream key;
+    key << "stat:" << st.st_dev << ':' << st.st_ino << ':' << st.st_size << ':'
+        << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+    return key.str();
+  }
+
+  std::string FileMetadataCache::fileIDKey(std::string const& fid, unsigned long long size) {
+    std::ostringstream key;
+    key << "fid:" << fid << ':' << size;
+    return key.str();
+  }
+
+  bool FileMetadataCache::lookup(std::string const& key, Record& record) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, Record>::const_iterator it = records_.find(key);
+    if(it == records_.end()) return false;
+    record = it->second;
+    return true;
+  }
+
+  void FileMetadataCache::store(std::string const& key, std::string const& fileName, Record const& fields) {
+    if(key.empty() || !writable(key) || !writable(fileName)) return;
+    for(Record::const_iterator it = fields.begin(), itEnd = fields.end(); it != itEnd; ++it) {
+      if(!writable(it->first) || !writable(it->second) || it->first.find('=') != std::string::npos) return;
+    }
+    std::string line;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::map<std::string, std::string>::iterator old = keyOfFile_.find(fileName);
+      if(old != keyOfFile_.end() && old->second != key) {
+        records_.erase(old->second);
+      }
+      keyOfFile_[fileName] = key;
+      Record& record = records_[key];
+      for(Record::const_iterator it = fields.begin(), itEnd = fields.end(); it != itEnd; ++it) {
+        record[it->first] = it->second;
+      }
+      line = formatRecord(key, fileName, record);
+    }
+    appendLocked(path_, line);
+  }
+
+  void FileMetadataCache::load() {
+    int fd = open(path_.c_str(), O_RDONLY);
+    if(fd < 0) return;
+    std::string text;
+    readFrom(fd, 0, text);
+    unsigned int nLines = 0;
+    size_t loaded = addLines(text, nLines);
+    // Rewrite the log when most of it is superseded records.
+    if(nLines > 2 * records_.size() + 100) {
+      compact(fd, loaded);
+    }
+    close(fd);
+  }
+
+  size_t FileMetadataCache::addLines(std::string const& text, unsigned int& nLines) {
+    size_t begin = 0;
+    for(;;) {
+      std::string::size_type newline = text.find('\n', begin);
+      // A last line without its newline is still being written.
+      if(newline == std::string::npos) return begin;
+      std::string line = text.substr(begin, newline - begin);
+      begin = newline + 1;
+      ++nLines;
+      std::vector<std::string> columns;
+      std::string::size_type columnBegin = 0;
+      for(;;) {
+        std::string::size_type end = line.find('\t', columnBegin);
+        columns.push_back(line.substr(columnBegin, end == std::string::npos ? std::string::npos : end - columnBegin));
+        if(end == std::string::npos) break;
+        columnBegin = end + 1;
+      }
+      // Skip lines written by other versions, and partial lines.
+      if(columns.size() < 3 || columns[0] != kRecordVersion) continue;
+      std::string const& key = columns[1];
+      std::string const& fileName = columns[2];
+      Record record;
+      for(size_t i = 3; i < columns.size(); ++i) {
+        std::string::size_type eq = columns[i].find('=');
+        if(eq == std::string::npos) continue;
+        record[columns[i].substr(0, eq)] = columns[i].substr(eq + 1);
+      }
+      std::map<std::string, std::string>::iterator old = keyOfFile_.find(fileName);
+      if(old != keyOfFile_.end() && old->second != key) {
+        records_.erase(old->second);
+      }
+      keyOfFile_[fileName] = key;
+      records_[key] = record;
+    }
+  }
+
+  void FileMetadataCache::compact(int fd, size_t loaded) {
+    // Hold the lock appenders take for the whole rewrite, so that no
+    // record is appended to the old file after it has been read.
+    if(flock(fd, LOCK_EX) != 0) return;
+    // Another process compacted the log first; leave its file alone.
+    if(!stillNamed(fd, path_)) {
+      flock(fd, LOCK_UN);
+      return;
+    }
+    // Take in what was appended since the load.
+    std::string tail;
+    readFrom(fd, loaded, tail);
+    unsigned int nLines = 0;
+    addLines(tail, nLines);
+
+    std::string text;
+    for(std::map<std::string, std::string>::const_iterator it = keyOfFile_.begin(), itEnd = keyOfFile_.end(); it != itEnd; ++it) {
+      std::map<std::string, Record>::const_iterator record = records_.find(it->second);
+      if(record != records_.end()) {
+        text += formatRecord(it->second, it->first, record->second);
+      }
+    }
+    // Write a new file and rename it over the old one, so that a reader
+    // never sees a half written cache.
+    std::ostringstream tmpName;
+    tmpName << path_ << ".tmp." << getpid();
+    bool written;
+    {
+      std::ofstream out(tmpName.str().c_str());
+      out << text;
+      out.close();
+      written = !out.fail();
+    }
+    if(!written || std::rename(tmpName.str().c_str(), path_.c_str()) != 0) {
+      std::remove(tmpName.str().c_str());
+    }
+    flock(fd, LOCK_UN);
+  }
+}
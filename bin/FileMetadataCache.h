@@ -0,0 +1,63 @@
+#ifndef IOPool_Common_FileMetadataCache_h
+#define IOPool_Common_FileMetadataCache_h
+
+// A persistent cache of per-file metadata (checksums, uuid, entry counts)
+// so that repeated queries on unchanged files need not read them again.
+//
+// The cache is an append-only text log, one record per line:
+//   key <TAB> path <TAB> field=value <TAB> field=value ...
+// Later records for a key replace earlier ones.  A key identifies the
+// file contents: for a local file it is built from the device, inode,
+// size and modification time, so any change to the file gives it a new
+// key and the old record is never matched again.  Stale records are
+// dropped when the log is compacted on load.
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace edm {
+
+  class FileMetadataCache {
+  public:
+    typedef std::map<std::string, std::string> Record;
+
+    // Loads the cache from 'path' (which need not exist yet).
+    explicit FileMetadataCache(std::string const& path);
+
+    FileMetadataCache(FileMetadataCache const&) = delete;
+    FileMetadataCache& operator=(FileMetadataCache const&) = delete;
+
+    // The identity key of local file 'path', or an empty string if it
+    // cannot be stat'ed.
+    static std::string localFileKey(std::string const& path);
+
+    // A key for a file known only by its FileID and size.
+    static std::string fileIDKey(std::string const& fid, unsigned long long size);
+
+    // Copies the record for 'key' into 'record' and returns true if there is one.
+    bool lookup(std::string const& key, Record& record) const;
+
+    // Adds 'fields' to the record for 'key', which refers to 'fileName',
+    // and appends the merged record to the log.  Any record for another
+    // key that refers to the same file name is forgotten.
+    void store(std::string const& key, std::string const& fileName, Record const& fields);
+
+  private:
+    void load();
+    // Adds the records of the complete lines of 'text', counting them in
+    // 'nLines', and returns the number of bytes those lines take.
+    size_t addLines(std::string const& text, unsigned int& nLines);
+    // Rewrites the log, open as 'fd', of which the first 'loaded' bytes
+    // have been read.
+    void compact(int fd, size_t loaded);
+
+    std::string path_;
+    std::map<std::string, Record> records_;      // key -> fields
+    std::map<std::string, std::string> keyOfFile_; // file name -> key
+    mutable std::mutex mutex_;
+  };
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include "IOPool/Common/bin/LfnResolver.h"
+#include "IOPool/Common/bin/FileMetadataCache.h"
+
+#include "FWCore/Catalog/interface/FileLocator.h"
+#include "FWCore/Catalog/interface/InputFileCatalog.h"
+#include "FWCore/Catalog/interface/SiteLocalConfig.h"
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/ServiceRegistry/interface/Service.h"
+#include "FWCore/ServiceRegistry/interface/ServiceRegistry.h"
+#include "FWCore/Services/src/SiteLocalConfigService.h"
+
+#include "boost/shared_ptr.hpp"
+
+#include <cstdlib>
+
+namespace edm {
+
+  namespace {
+    // The file named by catalog URL 'url', which looks like
+    // "trivialcatalog_file:/path/storage.xml?protocol=xrootd".
+    std::string catalogFile(std::string const& url) {
+      std::string::size_type begin = url.find(':');
+      begin = (begin == std::string::npos ? 0 : begin + 1);
+      std::string::size_type const end = url.find('?', begin);
+      return url.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+    }
+
+    // Catalog URL 'url' and the identity of the file it names, so that
+    // editing the catalog, or pointing at another one, changes the key.
+    // A missing file simply contributes an empty identity.
+    std::string catalogKey(std::string const& url) {
+      if(url.empty()) return url;
+      return url + "=" + FileMetadataCache::localFileKey(catalogFile(url));
+    }
+  }
+
+  LfnResolver::LfnResolver(std::string const& cachePath, std::string const& catalogOverride, bool refresh) :
+    cache_(),
+    catalogOverride_(catalogOverride),
+    configKey_(),
+    siteConfig_(),
+    siteConfigLoaded_(false),
+    overrideLocator_(),
+    siteLocator_(),
+    refresh_(refresh),
+    mutex_() {
+    if(!cachePath.empty()) {
+      cache_.reset(new FileMetadataCache(cachePath));
+    }
+  }
+
+  LfnResolver::~LfnResolver() {
+  }
+
+  std::string LfnResolver::defaultCachePath() {
+    char const* env = getenv("EDM_LFN_CACHE");
+    return env ? std::string(env) : std::string();
+  }
+
+  void LfnResolver::loadSiteConfig() {
+    if(siteConfigLoaded_) return;
+    std::auto_ptr<SiteLocalConfig> slcptr(new service::SiteLocalConfigService(ParameterSet()));
+    boost::shared_ptr<serviceregistry::ServiceWrapper<SiteLocalConfig> > slc(new serviceregistry::ServiceWrapper<SiteLocalConfig>(slcptr));
+    siteConfig_ = ServiceRegistry::createContaining(slc);
+    if(cache_) {
+      ServiceRegistry::Operate operate(siteConfig_);
+      Service<SiteLocalConfig> config;
+      configKey_ = catalogKey(catalogOverride_) + "|" + catalogKey(config->dataCatalog()) + "|" +
+                   catalogKey(config->fallbackDataCatalog());
+    }
+    siteConfigLoaded_ = true;
+  }
+
+  std::string LfnResolver::cacheKey(std::string const& name) const {
+    return "lfn:" + configKey_ + "|" + name;
+  }
+
+  void LfnResolver::loadCatalog() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    loadLocators();
+  }
+
+  void LfnResolver::loadLocators() {
+    if(siteLocator_) return;
+    loadSiteConfig();
+    // As InputFileCatalog does: the override catalog first, then the
+    // site's own.
+    ServiceRegistry::Operate operate(siteConfig_);
+    if(!catalogOverride_.empty()) overrideLocator_.reset(new FileLocator(catalogOverride_, false));
+    siteLocator_.reset(new FileLocator(std::string(), false));
+  }
+
+  std::vector<std::string> LfnResolver::resolve(std::vector<std::string> const& names) {
+    std::vector<std::string> pfns(names.size());
+    std::vector<unsigned int> logical;
+    for(unsigned int i = 0; i < names.size(); ++i) {
+      // Names which are already physical need neither cache nor catalog.
+      if(InputFileCatalog::isPhysical(names[i])) {
+        pfns[i] = names[i];
+      } else {
+        logical.push_back(i);
+      }
+    }
+    if(logical.empty()) return pfns;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The cache keys depend on the catalogs the site configuration names.
+    if(cache_) loadSiteConfig();
+    std::vector<unsigned int> missing;
+    for(std::vector<unsigned int>::const_iterator i = logical.begin(), iEnd = logical.end(); i != iEnd; ++i) {
+      FileMetadataCache::Record record;
+      FileMetadataCache::Record::const_iterator it;
+      if(cache_ && !refresh_ && cache_->lookup(cacheKey(names[*i]), record) && (it = record.find("pfn")) != record.end()) {
+        pfns[*i] = it->second;
+      } else {
+        missing.push_back(*i);
+      }
+    }
+    if(missing.empty()) return pfns;
+
+    loadLocators();
+    for(std::vector<unsigned int>::const_iterator i = missing.begin(), iEnd = missing.end(); i != iEnd; ++i) {
+      std::string const& lfn = names[*i];
+      std::string pfn;
+      if(overrideLocator_) pfn = overrideLocator_->pfn(lfn);
+      if(pfn.empty()) pfn = siteLocator_->pfn(lfn);
+      // Like InputFileCatalog, use the name itself if no catalog knows it.
+      if(pfn.empty()) pfn = lfn;
+      pfns[*i] = pfn;
+      if(cache_ && pfn != lfn) {
+        FileMetadataCache::Record record;
+        record["pfn"] = pfn;
+        cache_->store(cacheKey(lfn), lfn, record);
+      }
+    }
+    return pfns;
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef IOPool_Common_LfnResolver_h
+#define IOPool_Common_LfnResolver_h
+
+// LFN to PFN resolution shared by edmFileUtil and edmProvDump, with an
+// optional persistent cache so that scripts calling the tools once per
+// file do not pay for building the catalog each time.  Only the site
+// configuration is read on a cache hit.
+//
+// Cached resolutions are kept in a FileMetadataCache, keyed by the name
+// and by the catalog override, data catalog and fallback data catalog
+// URLs, each with the identity (device, inode, size and modification
+// time) of the catalog file it names.  The catalogs are those named by the
+// site configuration, so any change to which catalogs are used, or to the
+// catalogs themselves, invalidates every earlier resolution.  Names which
+// the catalog leaves unchanged are not cached.
+
+#include "FWCore/ServiceRegistry/interface/ServiceToken.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace edm {
+
+  class FileLocator;
+  class FileMetadataCache;
+
+  class LfnResolver {
+  public:
+    // 'cachePath' may be empty for no cache.  'catalogOverride' is passed
+    // on to InputFileCatalog.  With 'refresh' cached resolutions are not
+    // used, and are replaced by the new ones.
+    LfnResolver(std::string const& cachePath, std::string const& catalogOverride, bool refresh = false);
+    ~LfnResolver();
+
+    LfnResolver(LfnResolver const&) = delete;
+    LfnResolver& operator=(LfnResolver const&) = delete;
+
+    // The PFN of each of 'names', in the same order.  Names which are
+    // already physical are returned as they are; the others are looked up
+    // in the cache, then in the catalogs.  The resolver's own
+    // SiteLocalConfigService and catalogs are loaded on first use, and
+    // kept.  May be called from several threads at once.
+    std::vector<std::string> resolve(std::vector<std::string> const& names);
+
+    // Loads the site configuration and catalogs now rather than on first
+    // use, for a long running caller which should not pay for them on its
+    // first request.
+    void loadCatalog();
+
+    // The default cache path: $EDM_LFN_CACHE, or empty.
+    static std::string defaultCachePath();
+
+  private:
+    void loadSiteConfig();
+    void loadLocators();
+    std::string cacheKey(std::string const& name) const;
+
+    std::unique_ptr<FileMetadataCache> cache_;
+    std::string catalogOverride_;
+    std::string configKey_;
+    ServiceToken siteConfig_;
+    bool siteConfigLoaded_;
+    std::unique_ptr<FileLocator> overrideLocator_;
+    std::unique_ptr<FileLocator> siteLocator_;
+    bool refresh_;
+    std::mutex mutex_; // guards everything loaded on first use
+  };
+}
+
+#endif
@@ -0,0 +1,201 @@
+#include "IOPool/Common/bin/MergePlan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace edm {
+
+  namespace {
+    std::string joined(std::vector<std::string> const& names) {
+      std::string result;
+      for(std::vector<std::string>::const_iterator it = names.begin(), itEnd = names.end(); it != itEnd; ++it) {
+        if(!result.empty()) result += ' ';
+        result += *it;
+      }
+      return result;
+    }
+  }
+
+  std::string fastCloneBlocker(FileMergeInfo const& info) {
+    if(!info.fastCopyPossible) {
+      std::ostringstream why;
+      why << "file format version " << info.fileFormatVersion << " does not support fast copy";
+      return why.str();
+    }
+    if(!info.entryOrder) {
+      return "events are not stored in the order they are read";
+    }
+    return std::string();
+  }
+
+  bool fastCloneCompatible(FileMergeInfo const& a, FileMergeInfo const& b,
+                           std::vector<std::string>& why, std::vector<std::string>& notes) {
+    size_t const nWhy = why.size();
+    if(a.fileFormatVersion != b.fileFormatVersion) {
+      std::ostringstream s;
+      s << "file format version " << b.fileFormatVersion << " instead of " << a.fileFormatVersion;
+      why.push_back(s.str());
+    }
+
+    // Both branch lists are sorted by name.
+    std::vector<std::string> extra, missing, compression, basketSize;
+    std::vector<BranchSetting>::const_iterator ia = a.branches.begin(), ib = b.branches.begin();
+    while(ia != a.branches.end() || ib != b.branches.end()) {
+      if(ib == b.branches.end() || (ia != a.branches.end() && ia->name < ib->name)) {
+        missing.push_back(ia->name);
+        ++ia;
+      } else if(ia == a.branches.end() || ib->name < ia->name) {
+        extra.push_back(ib->name);
+        ++ib;
+      } else {
+        if(ia->compression != ib->compression) compression.push_back(ib->name);
+        if(ia->basketSize != ib->basketSize) basketSize.push_back(ib->name);
+        ++ia;
+        ++ib;
+      }
+    }
+    if(!extra.empty()) why.push_back("extra branches: " + joined(extra));
+    if(!missing.empty()) why.push_back("missing branches: " + joined(missing));
+    if(!compression.empty()) why.push_back("different compression settings: " + joined(compression));
+    if(!basketSize.empty()) notes.push_back("different basket sizes: " + joined(basketSize));
+
+    if(a.processHistories != b.processHistories) {
+      why.push_back("different process histories: " + joined(b.processHistories) + " instead of " + joined(a.processHistories));
+    }
+    return why.size() == nWhy;
+  }
+
+  std::vector<MergeGroup> planFastCloneGroups(std::vector<FileMergeInfo> const& infos) {
+    std::vector<MergeGroup> groups;
+    std::vector<std::string> why, notes;
+    for(unsigned int i = 0; i < infos.size(); ++i) {
+      std::string const blocker = fastCloneBlocker(infos[i]);
+      if(!blocker.empty()) {
+        MergeGroup group;
+        group.files.push_back(i);
+        group.fastClone = false;
+        group.reasons.push_back(blocker);
+        groups.push_back(group);
+        continue;
+      }
+      bool placed = false;
+      for(std::vector<MergeGroup>::iterator g = groups.begin(), gEnd = groups.end(); g != gEnd && !placed; ++g) {
+        if(!g->fastClone) continue;
+        why.clear();
+        notes.clear();
+        if(fastCloneCompatible(infos[g->files.front()], infos[i], why, notes)) {
+          g->files.push_back(i);
+          g->notes.insert(g->notes.end(), notes.begin(), notes.end());
+          placed = true;
+        }
+      }
+      if(placed) continue;
+      MergeGroup group;
+      group.files.push_back(i);
+      // Say how it differs from the first fast clonable group.
+      for(std::vector<MergeGroup>::const_iterator g = groups.begin(), gEnd = groups.end(); g != gEnd; ++g) {
+        if(!g->fastClone) continue;
+        why.clear();
+        notes.clear();
+        fastCloneCompatible(infos[g->files.front()], infos[i], why, notes);
+        group.reasons = why;
+        break;
+      }
+      groups.push_back(group);
+    }
+    return groups;
+  }
+
+  namespace {
+    // Orders file indices by the first and then the last run:lumi of the file.
+    class RunLumiOrder {
+    public:
+      explicit RunLumiOrder(std::vector<FileMergeInfo> const& infos) : infos_(infos) {}
+      bool operator()(unsigned int a, unsigned int b) const {
+        FileMergeInfo const& x = infos_[a];
+        FileMergeInfo const& y = infos_[b];
+        if(x.firstRun != y.firstRun) return x.firstRun < y.firstRun;
+        if(x.firstLumi != y.firstLumi) return x.firstLumi < y.firstLumi;
+        if(x.lastRun != y.lastRun) return x.lastRun < y.lastRun;
+        if(x.lastLumi != y.lastLumi) return x.lastLumi < y.lastLumi;
+        return a < b;
+      }
+    private:
+      std::vector<FileMergeInfo> const& infos_;
+    };
+
+    // Splits the files of one compatible class, already in run:lumi
+    // order, into consecutive groups of about the same size.
+    void packClass(std::vector<FileMergeInfo> const& infos, MergeGroup const& cls,
+                   unsigned long long targetBytes, std::vector<MergeGroup>& groups) {
+      unsigned long long total = 0;
+      for(std::vector<unsigned int>::const_iterator it = cls.files.begin(), itEnd = cls.files.end(); it != itEnd; ++it) {
+        total += infos[*it].bytes;
+      }
+      unsigned long long nGroups = targetBytes == 0 ? 1 : std::max(1ULL, (unsigned long long)std::floor(double(total) / targetBytes + 0.5));
+      double const goal = double(total) / nGroups;
+
+      MergeGroup group;
+      group.fastClone = cls.fastClone;
+      group.reasons = cls.reasons;
+      group.notes = cls.notes;
+      unsigned long long bytes = 0;
+      unsigned long long done = 0;
+      for(std::vector<unsigned int>::const_iterator it = cls.files.begin(), itEnd = cls.files.end(); it != itEnd; ++it) {
+        FileMergeInfo const& info = infos[*it];
+        if(!group.files.empty() && done + 1 < nGroups) {
+          FileMergeInfo const& last = infos[group.files.back()];
+          // A lumi continuing from the previous file must stay with it.
+          bool const continuesLumi = info.firstRun == last.lastRun && info.firstLumi == last.lastLumi;
+          bool const closer = std::fabs(double(bytes) - goal) <= std::fabs(double(bytes + info.bytes) - goal);
+          if(closer && !continuesLumi) {
+            groups.push_back(group);
+            group.files.clear();
+            bytes = 0;
+            ++done;
+          }
+        }
+        group.files.push_back(*it);
+        bytes += info.bytes;
+      }
+      if(!group.files.empty()) groups.push_back(group);
+    }
+  }
+
+  std::vector<MergeGroup> packMergeGroups(std::vector<FileMergeInfo> const& infos, unsigned long long targetBytes) {
+    // Classes of files which may share an output: the fast clone groups,
+    // and the files which cannot be fast cloned, split the same way.
+    std::vector<MergeGroup> classes;
+    std::vector<std::string> why, notes;
+    for(unsigned int i = 0; i < infos.size(); ++i) {
+      std::string const blocker = fastCloneBlocker(infos[i]);
+      bool placed = false;
+      for(std::vector<MergeGroup>::iterator c = classes.begin(), cEnd = classes.end(); c != cEnd && !placed; ++c) {
+        if(c->fastClone != blocker.empty()) continue;
+        why.clear();
+        notes.clear();
+        if(fastCloneCompatible(infos[c->files.front()], infos[i], why, notes)) {
+          c->files.push_back(i);
+          if(!blocker.empty() && std::find(c->reasons.begin(), c->reasons.end(), blocker) == c->reasons.end()) {
+            c->reasons.push_back(blocker);
+          }
+          placed = true;
+        }
+      }
+      if(placed) continue;
+      MergeGroup cls;
+      cls.files.push_back(i);
+      cls.fastClone = blocker.empty();
+      if(!blocker.empty()) cls.reasons.push_back(blocker);
+      classes.push_back(cls);
+    }
+
+    std::vector<MergeGroup> groups;
+    for(std::vector<MergeGroup>::iterator c = classes.begin(), cEnd = classes.end(); c != cEnd; ++c) {
+      std::sort(c->files.begin(), c->files.end(), RunLumiOrder(infos));
+      packClass(infos, *c, targetBytes, groups);
+    }
+    return groups;
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef IOPool_Common_MergePlan_h
+#define IOPool_Common_MergePlan_h
+
+// Planning of PoolSource -> PoolOutputModule merges from the metadata
+// read by readFileMergeInfo, without reading any event data.
+//
+// A merge fast clones an input file (copies its baskets without
+// unpacking them) only if its events are stored in entry order, its file
+// format version allows it, and its Events tree has the same branches,
+// compression and process histories as the other files of the merge.
+// Anything else sends the file down the slow path.
+
+#include "IOPool/Common/bin/CollUtil.h"
+
+#include <string>
+#include <vector>
+
+namespace edm {
+
+  // Why 'info' cannot be fast cloned whatever it is merged with, or an
+  // empty string if it can.
+  std::string fastCloneBlocker(FileMergeInfo const& info);
+
+  // True if 'a' and 'b' can be fast cloned into the same output.  Adds a
+  // line to 'why' for each difference which prevents it, and to 'notes'
+  // for each which does not (such as different basket sizes).
+  bool fastCloneCompatible(FileMergeInfo const& a, FileMergeInfo const& b,
+                           std::vector<std::string>& why, std::vector<std::string>& notes);
+
+  struct MergeGroup {
+    MergeGroup() : files(), fastClone(true), reasons(), notes() {}
+    std::vector<unsigned int> files;  // indices into the input, in input order
+    bool fastClone;
+    std::vector<std::string> reasons; // why the group is not fast clonable, or is kept apart from the first group
+    std::vector<std::string> notes;
+  };
+
+  // Splits the files into groups which can each be merged with fast
+  // cloning.  Files which can never be fast cloned each get a group of
+  // their own with fastClone false.
+  std::vector<MergeGroup> planFastCloneGroups(std::vector<FileMergeInfo> const& infos);
+
+  // Packs the files into merge groups of about 'targetBytes' each.  Files
+  // are only grouped with files they could be fast cloned with (files
+  // which cannot be fast cloned at all are grouped with files of the same
+  // branches and histories).  Within a group files are in run:lumi order,
+  // and a luminosity block is never split between groups.  The number of
+  // groups is chosen so that their sizes are as even as possible.
+  std::vector<MergeGroup> packMergeGroups(std::vector<FileMergeInfo> const& infos, unsigned long long targetBytes);
+}
+
+#endif
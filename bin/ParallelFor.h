@@ -0,0 +1,105 @@
+#ifndef IOPool_Common_ParallelFor_h
+#define IOPool_Common_ParallelFor_h
+
+// Small helpers used by the edmFileUtil family of tools to spread
+// independent per-file (or per-range) work over a fixed number of threads.
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace edm {
+
+  // Calls work(i) for every i in [0, n) using up to nThreads threads.
+  // Then calls emit(i) on the calling thread for every i, in increasing
+  // order of i, as soon as work(i) has finished and emit(i-1) has returned.
+  // No more than 'window' items past the last emitted one are started, which
+  // bounds the number of results (for example open files) held at once.
+  // A window of 0 means "unbounded". If any call to work or emit throws,
+  // the remaining items are still processed and the first exception is
+  // rethrown once all threads have been joined.  With one thread (or one
+  // item) everything runs on the calling thread and the first exception
+  // propagates at once, without processing the remaining items; callers
+  // which stop on the first failure rely on this.
+  template<typename Work, typename Emit>
+  void orderedParallelFor(unsigned int n, unsigned int nThreads, unsigned int window, Work work, Emit emit) {
+    if(nThreads <= 1 || n <= 1) {
+      for(unsigned int i = 0; i < n; ++i) {
+        work(i);
+        emit(i);
+      }
+      return;
+    }
+    if(nThreads > n) nThreads = n;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<char> done(n, 0);
+    unsigned int next = 0;
+    unsigned int emitted = 0;
+    std::exception_ptr firstException;
+
+    auto worker = [&]() {
+      for(;;) {
+        unsigned int i;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() { return next >= n || window == 0 || next < emitted + window; });
+          if(next >= n) return;
+          i = next++;
+        }
+        try {
+          work(i);
+        } catch(...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if(!firstException) firstException = std::current_exception();
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          done[i] = 1;
+        }
+        cond.notify_all();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(nThreads);
+    for(unsigned int t = 0; t < nThreads; ++t) {
+      threads.emplace_back(worker);
+    }
+
+    for(unsigned int i = 0; i < n; ++i) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return done[i] != 0; });
+      }
+      try {
+        emit(i);
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!firstException) firstException = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        emitted = i + 1;
+      }
+      cond.notify_all();
+    }
+
+    for(auto& thread : threads) {
+      thread.join();
+    }
+    if(firstException) std::rethrow_exception(firstException);
+  }
+
+  // Calls work(i) for every i in [0, n) using up to nThreads threads,
+  // in no particular order.
+  template<typename Work>
+  void parallelFor(unsigned int n, unsigned int nThreads, Work work) {
+    orderedParallelFor(n, nThreads, 0, work, [](unsigned int) {});
+  }
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include "IOPool/Common/bin/QueryServer.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace edm {
+
+  namespace {
+    char const* const kShutdownReport = "shutdown";
+    // How often the accept loop looks for a signal, in milliseconds.
+    int const kPollInterval = 200;
+    // How long a client may take to send its request, or to take each
+    // part of the reply, before its worker gives up on it, in seconds.
+    int const kRequestTimeout = 30;
+    // Requests are one short line; anything longer is not a client.
+    size_t const kMaxRequestSize = 64 * 1024;
+
+    volatile sig_atomic_t signalled = 0;
+
+    extern "C" void stopServing(int) {
+      signalled = 1;
+    }
+
+    sockaddr_un socketAddress(std::string const& path) {
+      sockaddr_un address;
+      std::memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      if(path.size() >= sizeof(address.sun_path)) {
+        throw cms::Exception("SocketError", "QueryServer")
+          << "Socket path " << path << " is longer than " << sizeof(address.sun_path) - 1 << " characters.\n";
+      }
+      std::strcpy(address.sun_path, path.c_str());
+      return address;
+    }
+
+    // A connected socket to 'path', or -1 if nothing is listening on it.
+    int connectTo(std::string const& path) {
+      sockaddr_un const address = socketAddress(path);
+      int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      if(fd < 0) return -1;
+      if(connect(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0) {
+        int const err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+      }
+      return fd;
+    }
+
+    bool writeAll(int fd, std::string const& data) {
+      char const* p = data.data();
+      size_t size = data.size();
+      while(size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        size -= n;
+      }
+      return true;
+    }
+
+    // Reads until end of file, or until a newline if 'line' is set, in
+    // which case more than kMaxRequestSize bytes is an error.
+    bool readAll(int fd, std::string& data, bool line) {
+      char buffer[4096];
+      while(true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0) return false;
+        if(n == 0) return true;
+        data.append(buffer, n);
+        if(line && data.find('\n') != std::string::npos) return true;
+        if(line && data.size() > kMaxRequestSize) return false;
+      }
+    }
+
+    // Bounds how long a worker can be held by a client which stops sending
+    // or reading; a blocked read or write then fails with EAGAIN.
+    void setTimeouts(int fd) {
+      timeval timeout;
+      timeout.tv_sec = kRequestTimeout;
+      timeout.tv_usec = 0;
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+
+    // Answers the request on connection 'fd'.  Returns false if it was a
+    // shutdown request.
+    bool serve(int fd, QueryServer::Handler const& handler) {
+      std::string request;
+      if(!readAll(fd, request, true)) return true;
+      request = request.substr(0, request.find('\n'));
+      std::string::size_type const tab = request.find('\t');
+      std::string const report = request.substr(0, tab);
+      std::string const file = tab == std::string::npos ? std::string() : request.substr(tab + 1);
+      if(report == kShutdownReport) {
+        writeAll(fd, "OK\n");
+        return false;
+      }
+      std::string output;
+      bool ok = false;
+      try {
+        ok = handler(report, file, output);
+      } catch(cms::Exception const& e) {
+        output = e.explainSelf();
+      } catch(std::exception const& e) {
+        output = e.what();
+      } catch(...) {
+        output = "Unknown exception\n";
+      }
+      writeAll(fd, (ok ? "OK\n" : "ERROR\n") + output);
+      return true;
+    }
+  }
+
+  QueryServer::QueryServer(std::string const& socketPath) :
+    socketPath_(socketPath),
+    fd_(-1) {
+    struct stat st;
+    if(lstat(socketPath.c_str(), &st) == 0) {
+      int other = connectTo(socketPath);
+      if(other >= 0) {
+        close(other);
+        throw cms::Exception("SocketError", "QueryServer")
+          << "Another server is already listening on " << socketPath << ".\n";
+      }
+      if(!S_ISSOCK(st.st_mode)) {
+        throw cms::Exception("SocketError", "QueryServer")
+          << socketPath << " exists and is not a socket.\n";
+      }
+      unlink(socketPath.c_str());
+    }
+    sockaddr_un const address = socketAddress(socketPath);
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    // Only the owner may send requests, whatever the umask.  Nothing can
+    // connect before listen(), so there is no window with wider access.
+    if(fd_ < 0 ||
+       bind(fd_, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0 ||
+       chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+       listen(fd_, SOMAXCONN) != 0) {
+      int const err = errno;
+      if(fd_ >= 0) close(fd_);
+      throw cms::Exception("SocketError", "QueryServer")
+        << "Could not listen on " << socketPath << ": " << strerror(err) << "\n";
+    }
+  }
+
+  QueryServer::~QueryServer() {
+    close(fd_);
+    unlink(socketPath_.c_str());
+  }
+
+  unsigned long long QueryServer::run(unsigned int nWorkers, Handler const& handler) {
+    struct sigaction action, oldInt, oldTerm;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServing;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &oldInt);
+    sigaction(SIGTERM, &action, &oldTerm);
+    signalled = 0;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> connections;
+    std::atomic<bool> stop(false);
+    std::atomic<unsigned long long> nServed(0);
+
+    std::vector<std::thread> workers;
+    for(unsigned int i = 0; i < std::max(nWorkers, 1U); ++i) {
+      workers.push_back(std::thread([&]() {
+        while(true) {
+          int fd;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return stop || !connections.empty(); });
+            if(connections.empty()) return;
+            fd = connections.front();
+            connections.pop_front();
+          }
+          if(!serve(fd, handler)) stop = true;
+          close(fd);
+          ++nServed;
+        }
+      }));
+    }
+
+    while(!stop && !signalled) {
+      pollfd listening;
+      listening.fd = fd_;
+      listening.events = POLLIN;
+      listening.revents = 0;
+      if(poll(&listening, 1, kPollInterval) <= 0) continue;
+      int fd = accept(fd_, 0, 0);
+      if(fd < 0) continue;
+      setTimeouts(fd);
+      std::lock_guard<std::mutex> lock(mutex);
+      connections.push_back(fd);
+      ready.notify_one();
+    }
+
+    // Requests already accepted are still answered.
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    ready.notify_all();
+    for(std::vector<std::thread>::iterator it = workers.begin(), itEnd = workers.end(); it != itEnd; ++it) {
+      it->join();
+    }
+    sigaction(SIGINT, &oldInt, 0);
+    sigaction(SIGTERM, &oldTerm, 0);
+    return nServed;
+  }
+
+  bool sendQuery(std::string const& socketPath, std::string const& report, std::string const& file, std::string& output) {
+    int fd = connectTo(socketPath);
+    if(fd < 0) {
+      throw cms::Exception("SocketError", "sendQuery")
+        << "Could not connect to a server on " << socketPath << ": " << strerror(errno) << "\n";
+    }
+    std::string reply;
+    bool const sent = writeAll(fd, report + "\t" + file + "\n") && shutdown(fd, SHUT_WR) == 0 && readAll(fd, reply, false);
+    close(fd);
+    std::string::size_type const newline = reply.find('\n');
+    if(!sent || newline == std::string::npos) {
+      throw cms::Exception("SocketError", "sendQuery")
+        << "No reply from the server on " << socketPath << ".\n";
+    }
+    output = reply.substr(newline + 1);
+    return reply.compare(0, newline, "OK") == 0;
+  }
+}
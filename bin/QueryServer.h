@@ -0,0 +1,54 @@
+#ifndef IOPool_Common_QueryServer_h
+#define IOPool_Common_QueryServer_h
+
+// A Unix domain socket server answering one report request per
+// connection, and the matching client call, so that callers issuing many
+// small queries pay for plugin, dictionary and service start-up once.
+//
+// The client writes one line, "<report>\t<file>\n", and shuts down its
+// side of the connection.  The server replies "OK\n" or "ERROR\n"
+// followed by the report (or the error message), and closes the
+// connection.  A request for the report "shutdown" stops the server.
+//
+// The socket is only accessible to its owner.  A client which sends an
+// over-long request, or stalls while sending it or reading the reply, is
+// disconnected so that it cannot hold a worker, or a server shutdown.
+
+#include <functional>
+#include <string>
+
+namespace edm {
+
+  class QueryServer {
+  public:
+    // Fills 'output' with report 'report' for 'file'.  Returns false, with
+    // the reason in 'output', if the report could not be made.  Exceptions
+    // are turned into error replies.  Called concurrently from the
+    // workers.
+    typedef std::function<bool (std::string const& report, std::string const& file, std::string& output)> Handler;
+
+    // Binds and listens on 'socketPath'.  A stale socket left by a server
+    // which is no longer running is replaced; throws if another server is
+    // listening on it or it cannot be created.
+    explicit QueryServer(std::string const& socketPath);
+    ~QueryServer();
+
+    QueryServer(QueryServer const&) = delete;
+    QueryServer& operator=(QueryServer const&) = delete;
+
+    // Serves requests, up to 'nWorkers' at a time, until a "shutdown"
+    // request, SIGINT or SIGTERM.  Returns the number of requests served.
+    unsigned long long run(unsigned int nWorkers, Handler const& handler);
+
+  private:
+    std::string socketPath_;
+    int fd_;
+  };
+
+  // Sends one request to the server on 'socketPath' and waits for the
+  // reply.  Returns true if the server answered OK.  Throws if the server
+  // cannot be reached.
+  bool sendQuery(std::string const& socketPath, std::string const& report, std::string const& file, std::string& output);
+}
+
+#endif
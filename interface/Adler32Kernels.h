@@ -0,0 +1,34 @@
+#ifndef IOPool_Common_Adler32Kernels_h
+#define IOPool_Common_Adler32Kernels_h
+
+// Adler-32 update functions.  All of them continue a running checksum
+// held in the (a, b) pair, exactly as cms::Adler32 does, and produce
+// bit-identical results: the checksum is (b << 16) | a.
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace edm {
+
+  // The fastest implementation supported by the CPU we are running on,
+  // selected on the first call.
+  void adler32Update(char const* data, size_t len, uint32_t& a, uint32_t& b);
+
+  // The checksum of the concatenation of two pieces of data, given the
+  // checksum of each piece and the length of the second piece.
+  uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, uint64_t len2);
+
+  // Name of the implementation used by adler32Update ("avx2", "ssse3" or "scalar").
+  char const* adler32KernelName();
+
+  // The individual implementations, for testing and benchmarking.
+  // The vectorized ones must only be called if the matching *Supported()
+  // function returns true.
+  void adler32UpdateScalar(char const* data, size_t len, uint32_t& a, uint32_t& b);
+  void adler32UpdateSSSE3(char const* data, size_t len, uint32_t& a, uint32_t& b);
+  void adler32UpdateAVX2(char const* data, size_t len, uint32_t& a, uint32_t& b);
+  bool adler32SSSE3Supported();
+  bool adler32AVX2Supported();
+}
+
+#endif
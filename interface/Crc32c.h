@@ -0,0 +1,24 @@
+#ifndef IOPool_Common_Crc32c_h
+#define IOPool_Common_Crc32c_h
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and many storage systems.
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace edm {
+
+  // Continue the CRC-32C 'crc' of earlier data with 'len' more bytes.
+  // Start with crc = 0; the value returned is the finished checksum of
+  // everything seen so far.  Uses the SSE4.2 crc32 instruction if the CPU
+  // we are running on has it.
+  uint32_t crc32cUpdate(uint32_t crc, char const* data, size_t len);
+
+  // The individual implementations, for testing.  The hardware one must
+  // only be called if crc32cHardwareSupported() returns true.
+  uint32_t crc32cUpdateSoftware(uint32_t crc, char const* data, size_t len);
+  uint32_t crc32cUpdateHardware(uint32_t crc, char const* data, size_t len);
+  bool crc32cHardwareSupported();
+}
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef IOPool_Common_FileContents_h
+#define IOPool_Common_FileContents_h
+
+// What an EDM file holds, read into plain structs: its tree and entry
+// counts, the storage of its branches, and its run/lumi/event tables.
+//
+// Nothing here writes to any stream or keeps any state between calls, so
+// different files may be read concurrently from different threads (each
+// TFile must only be used by one thread at a time).  The edmFileUtil
+// reports are formatters on top of these.
+
+#include "DataFormats/Provenance/interface/EventID.h"
+#include "Rtypes.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class TFile;
+class TTree;
+
+namespace edm {
+
+  // The counts printed in the one line summary of a file.  Counts of trees
+  // which are missing are -1.
+  struct FileSummary {
+    FileSummary() : runs(-1), lumis(-1), events(-1), bytes(0), uuid(), recovered(false) {}
+    Long64_t runs;
+    Long64_t lumis;
+    Long64_t events;
+    Long64_t bytes;
+    std::string uuid;   // empty unless asked for
+    bool recovered;     // ROOT had to recover the file, which was not closed properly
+  };
+  // With 'fromKeys' the entry counts are read from the key directory
+  // without building the trees (see TreeEntryCount.h).
+  FileSummary readFileSummary(TFile* tfl, bool withUuid, bool fromKeys);
+
+  // The uuid of a file, from its MetaData tree.
+  std::string readUuid(TTree* metaDataTree);
+
+  // The storage of one top level branch, including all of its
+  // sub-branches.
+  struct BranchSizeInfo {
+    BranchSizeInfo() : name(), totalSize(0), zipBytes(0), totBytes(0), baskets(0), basketEntries(0),
+                       minBasket(0), medianBasket(0), maxBasket(0) {}
+    double ratio() const { return zipBytes > 0 ? double(totBytes) / zipBytes : 0.; }
+    double entriesPerBasket() const { return baskets > 0 ? double(basketEntries) / baskets : 0.; }
+    std::string name;
+    Long64_t totalSize;     // TBranch::GetTotalSize, which includes the branch metadata
+    Long64_t zipBytes;
+    Long64_t totBytes;
+    Long64_t baskets;
+    Long64_t basketEntries; // Entries summed over every (sub-)branch with baskets.
+    Long64_t minBasket;     // compressed basket sizes
+    Long64_t medianBasket;
+    Long64_t maxBasket;
+  };
+  // One entry per top level branch of 'tree', in branch order.
+  std::vector<BranchSizeInfo> readBranchSizes(TTree* tree);
+
+  // One row of a file's run/lumi/event index.
+  struct EventTableRow {
+    enum Type { kRun, kLumi, kEvent };
+    Type type;
+    RunNumber_t run;
+    LuminosityBlockNumber_t lumi;
+    EventNumber_t event;  // 0 for runs and lumis
+    Long64_t entry;       // in the tree of its type
+  };
+  // A file's run/lumi/event index, in the order the rows appear in the
+  // file, and what it implies for fast copying.
+  struct EventTable {
+    enum Source { kFileIndex, kIndexIntoFile };
+    // Why there are no rows, if there are none.  kNoEventAuxiliary also
+    // covers a file with IndexIntoFile but no Events tree.
+    enum Problem { kNoProblem, kNoMetaData, kNoFileIndex, kNoIndexIntoFile, kNoEventAuxiliary };
+    EventTable() : source(kIndexIntoFile), problem(kNoProblem), fileFormatVersion(0), versionSupportsFastCopy(false),
+                   rows(), fastCopyPossible(false), noEventSortKnown(false), fastCopyPossibleNoEventSort(false) {}
+    Source source;
+    Problem problem;
+    int fileFormatVersion;
+    bool versionSupportsFastCopy;
+    std::vector<EventTableRow> rows;
+    bool fastCopyPossible;            // events are in entry order when sorted
+    bool noEventSortKnown;            // whether the next member could be worked out
+    bool fastCopyPossibleNoEventSort; // events are in entry order when not sorted
+  };
+  // Reads the index and, for files with IndexIntoFile, the event number
+  // of every event, in entry order.  Returns false, with 'problem' set, if
+  // the table could not be read.
+  bool readEventTable(TFile* tfl, EventTable& table);
+
+  // The number of events in one luminosity block of one file.
+  struct LumiEventCount {
+    LumiEventCount() : run(0), lumi(0), events(0) {}
+    LumiEventCount(RunNumber_t r, LuminosityBlockNumber_t l) : run(r), lumi(l), events(0) {}
+    RunNumber_t run;
+    LuminosityBlockNumber_t lumi;
+    unsigned long long events;
+  };
+  // Fill 'counts' with the events in each luminosity block of 'tfl', in
+  // file order, reading only IndexIntoFile (or FileIndex for old files).
+  // Returns false if the file has neither.
+  bool readEventsInLumis(TFile* tfl, std::vector<LumiEventCount>& counts);
+  // As above, setting 'problem' to what was missing on failure.
+  bool readEventsInLumis(TFile* tfl, std::vector<LumiEventCount>& counts, EventTable::Problem& problem);
+
+  // Where one event is stored in a file.
+  struct EventEntry {
+    RunNumber_t run;
+    LuminosityBlockNumber_t lumi;
+    EventNumber_t event;
+    Long64_t entry; // in the Events tree
+  };
+  // Fill 'events' with every event of 'tfl', in file order.  The event
+  // numbers of files with IndexIntoFile are read from EventAuxiliary in
+  // entry order.  Returns false if the file has no index.
+  bool readEventEntries(TFile* tfl, std::vector<EventEntry>& events);
+  // As above, but only for the events of the luminosity blocks for which
+  // 'wantLumi' returns true.  EventAuxiliary is only read for those.
+  typedef std::function<bool (RunNumber_t, LuminosityBlockNumber_t)> LumiSelector;
+  bool readEventEntries(TFile* tfl, std::vector<EventEntry>& events, LumiSelector const& wantLumi);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef IOPool_Common_TreeEntryCount_h
+#define IOPool_Common_TreeEntryCount_h
+
+// Entry counts of the trees of a file, read from its key directory and
+// the first bytes of each tree's record.
+//
+// TDirectory::Get builds the whole TTree, with every branch and the
+// basket bookkeeping of each, which for files with thousands of branches
+// costs far more than anything else needed to summarize the file.  The
+// entry count is stored just after the TTree's base classes, so it can
+// be decoded from the start of the record on its own.
+
+#include "Rtypes.h"
+
+class TDirectory;
+
+namespace edm {
+
+  // Returned by treeEntriesFromKey if 'dir' has no TTree called 'name'.
+  Long64_t const kNoSuchTree = -1;
+  // Returned if the record could not be decoded (a layout this does not
+  // know, or a read error).  Callers should fall back to TDirectory::Get.
+  Long64_t const kUndecodedTree = -2;
+
+  // The number of entries of the highest cycle of TTree 'name' in 'dir',
+  // without instantiating it.  Reads at most the first compressed block
+  // of the record.
+  Long64_t treeEntriesFromKey(TDirectory* dir, char const* name);
+}
+
+#endif
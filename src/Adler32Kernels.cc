@@ -0,0 +1,205 @@
+#include "IOPool/Common/interface/Adler32Kernels.h"
+
+#include "FWCore/Utilities/interface/Adler32Calculator.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define IOPOOL_COMMON_ADLER32_X86 1
+#include <immintrin.h>
+#endif
+
+namespace edm {
+
+  namespace {
+    // Largest n such that 255n(n+1)/2 + (n+1)(BASE-1) <= 2^32-1, as in zlib.
+    // Reducing modulo BASE at least this often keeps every sum in 32 bits.
+    unsigned int const kAdlerNMax = 5552;
+    uint32_t const kAdlerBase = 65521;
+    size_t const kBlockSize = 32;
+  }
+
+  void adler32UpdateScalar(char const* data, size_t len, uint32_t& a, uint32_t& b) {
+    cms::Adler32(data, len, a, b);
+  }
+
+#ifdef IOPOOL_COMMON_ADLER32_X86
+
+  bool adler32SSSE3Supported() {
+    return __builtin_cpu_supports("ssse3");
+  }
+
+  bool adler32AVX2Supported() {
+    return __builtin_cpu_supports("avx2");
+  }
+
+  // Processes 32 byte blocks as two 16 byte halves.  For each block the
+  // byte sum goes into s1, and the byte sum weighted by 32..1 goes into
+  // s2, while v_ps accumulates the s1 value at the start of each block
+  // (the 32 * s1 term that each block adds to s2).
+  __attribute__((target("ssse3")))
+  void adler32UpdateSSSE3(char const* data, size_t len, uint32_t& a, uint32_t& b) {
+    unsigned char const* buf = reinterpret_cast<unsigned char const*>(data);
+    uint32_t s1 = a;
+    uint32_t s2 = b;
+    size_t blocks = len / kBlockSize;
+    len -= blocks * kBlockSize;
+
+    __m128i const tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+    __m128i const tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const ones = _mm_set1_epi16(1);
+
+    while(blocks != 0) {
+      size_t n = kAdlerNMax / kBlockSize;
+      if(n > blocks) n = blocks;
+      blocks -= n;
+
+      __m128i v_ps = _mm_set_epi32(0, 0, 0, s1 * n);
+      __m128i v_s2 = _mm_set_epi32(0, 0, 0, s2);
+      __m128i v_s1 = _mm_setzero_si128();
+      do {
+        __m128i const bytes1 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(buf));
+        __m128i const bytes2 = _mm_loadu_si128(reinterpret_cast<__m128i const*>(buf + 16));
+        v_ps = _mm_add_epi32(v_ps, v_s1);
+        v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+        v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+        v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+        v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+        buf += kBlockSize;
+      } while(--n != 0);
+      v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+      // Horizontal sums of the 32 bit lanes.
+      v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+      s1 += _mm_cvtsi128_si32(v_s1);
+      v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+      v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+      s2 = _mm_cvtsi128_si32(v_s2);
+
+      s1 %= kAdlerBase;
+      s2 %= kAdlerBase;
+    }
+
+    a = s1;
+    b = s2;
+    if(len != 0) {
+      cms::Adler32(reinterpret_cast<char const*>(buf), len, a, b);
+    }
+  }
+
+  // The same algorithm as the SSSE3 version, one 32 byte block per
+  // 256 bit register.
+  __attribute__((target("avx2")))
+  void adler32UpdateAVX2(char const* data, size_t len, uint32_t& a, uint32_t& b) {
+    unsigned char const* buf = reinterpret_cast<unsigned char const*>(data);
+    uint32_t s1 = a;
+    uint32_t s2 = b;
+    size_t blocks = len / kBlockSize;
+    len -= blocks * kBlockSize;
+
+    __m256i const tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                         16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const ones = _mm256_set1_epi16(1);
+
+    while(blocks != 0) {
+      size_t n = kAdlerNMax / kBlockSize;
+      if(n > blocks) n = blocks;
+      blocks -= n;
+
+      __m256i v_ps = _mm256_setr_epi32(s1 * n, 0, 0, 0, 0, 0, 0, 0);
+      __m256i v_s2 = _mm256_setr_epi32(s2, 0, 0, 0, 0, 0, 0, 0);
+      __m256i v_s1 = _mm256_setzero_si256();
+      do {
+        __m256i const bytes = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(buf));
+        v_ps = _mm256_add_epi32(v_ps, v_s1);
+        v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+        v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+        buf += kBlockSize;
+      } while(--n != 0);
+      v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+
+      // Horizontal sums of the 32 bit lanes.
+      __m128i h_s1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+      h_s1 = _mm_add_epi32(h_s1, _mm_shuffle_epi32(h_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+      s1 += _mm_cvtsi128_si32(h_s1);
+      __m128i h_s2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+      h_s2 = _mm_add_epi32(h_s2, _mm_shuffle_epi32(h_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+      h_s2 = _mm_add_epi32(h_s2, _mm_shuffle_epi32(h_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+      s2 = _mm_cvtsi128_si32(h_s2);
+
+      s1 %= kAdlerBase;
+      s2 %= kAdlerBase;
+    }
+
+    a = s1;
+    b = s2;
+    if(len != 0) {
+      cms::Adler32(reinterpret_cast<char const*>(buf), len, a, b);
+    }
+  }
+
+#else
+
+  bool adler32SSSE3Supported() {
+    return false;
+  }
+
+  bool adler32AVX2Supported() {
+    return false;
+  }
+
+  void adler32UpdateSSSE3(char const* data, size_t len, uint32_t& a, uint32_t& b) {
+    cms::Adler32(data, len, a, b);
+  }
+
+  void adler32UpdateAVX2(char const* data, size_t len, uint32_t& a, uint32_t& b) {
+    cms::Adler32(data, len, a, b);
+  }
+
+#endif
+
+  namespace {
+    typedef void (*Adler32UpdateFunction)(char const*, size_t, uint32_t&, uint32_t&);
+
+    struct Adler32Kernel {
+      Adler32Kernel() : update(&adler32UpdateScalar), name("scalar") {
+        if(adler32AVX2Supported()) {
+          update = &adler32UpdateAVX2;
+          name = "avx2";
+        } else if(adler32SSSE3Supported()) {
+          update = &adler32UpdateSSSE3;
+          name = "ssse3";
+        }
+      }
+      Adler32UpdateFunction update;
+      char const* name;
+    };
+
+    Adler32Kernel const& selectedKernel() {
+      static Adler32Kernel const kernel;
+      return kernel;
+    }
+  }
+
+  void adler32Update(char const* data, size_t len, uint32_t& a, uint32_t& b) {
+    selectedKernel().update(data, len, a, b);
+  }
+
+  char const* adler32KernelName() {
+    return selectedKernel().name;
+  }
+
+  // With n the length of the second piece, a = a1 + a2 - 1 and
+  // b = b1 + b2 + n * (a1 - 1), all modulo BASE (as zlib's adler32_combine).
+  uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, uint64_t len2) {
+    uint64_t const rem = len2 % kAdlerBase;
+    uint64_t sum1 = adler1 & 0xffff;
+    uint64_t sum2 = (rem * sum1) % kAdlerBase;
+    sum1 += (adler2 & 0xffff) + kAdlerBase - 1;
+    sum2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + kAdlerBase - rem;
+    sum1 %= kAdlerBase;
+    sum2 %= kAdlerBase;
+    return static_cast<uint32_t>(sum1 | (sum2 << 16));
+  }
+}
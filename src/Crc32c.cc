@@ -0,0 +1,118 @@
+#include "IOPool/Common/interface/Crc32c.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define IOPOOL_COMMON_CRC32C_X86 1
+#include <nmmintrin.h>
+#endif
+
+namespace edm {
+
+  namespace {
+    // Reflected Castagnoli polynomial.
+    uint32_t const kCrc32cPolynomial = 0x82f63b78;
+
+    // table[k][b] is the CRC of byte b followed by k zero bytes, which lets
+    // the software version process eight bytes per step ("slicing by 8").
+    struct Crc32cTables {
+      Crc32cTables() {
+        for(uint32_t i = 0; i < 256; ++i) {
+          uint32_t crc = i;
+          for(int j = 0; j < 8; ++j) {
+            crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPolynomial : crc >> 1;
+          }
+          table[0][i] = crc;
+        }
+        for(uint32_t i = 0; i < 256; ++i) {
+          for(int k = 1; k < 8; ++k) {
+            table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+          }
+        }
+      }
+      uint32_t table[8][256];
+    };
+
+    Crc32cTables const& crc32cTables() {
+      static Crc32cTables const tables;
+      return tables;
+    }
+  }
+
+  uint32_t crc32cUpdateSoftware(uint32_t crc, char const* data, size_t len) {
+    uint32_t const (*t)[256] = crc32cTables().table;
+    unsigned char const* p = reinterpret_cast<unsigned char const*>(data);
+    crc = ~crc;
+    while(len >= 8) {
+      uint32_t lo, hi;
+      std::memcpy(&lo, p, 4);
+      std::memcpy(&hi, p + 4, 4);
+      // Little endian byte order is assumed, as on every platform CMSSW supports.
+      lo ^= crc;
+      crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+            t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+      p += 8;
+      len -= 8;
+    }
+    while(len != 0) {
+      crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+      ++p;
+      --len;
+    }
+    return ~crc;
+  }
+
+#ifdef IOPOOL_COMMON_CRC32C_X86
+
+  bool crc32cHardwareSupported() {
+    return __builtin_cpu_supports("sse4.2");
+  }
+
+  __attribute__((target("sse4.2")))
+  uint32_t crc32cUpdateHardware(uint32_t crc, char const* data, size_t len) {
+    unsigned char const* p = reinterpret_cast<unsigned char const*>(data);
+    crc = ~crc;
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while(len >= 8) {
+      uint64_t word;
+      std::memcpy(&word, p, 8);
+      crc64 = _mm_crc32_u64(crc64, word);
+      p += 8;
+      len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    while(len >= 4) {
+      uint32_t word;
+      std::memcpy(&word, p, 4);
+      crc = _mm_crc32_u32(crc, word);
+      p += 4;
+      len -= 4;
+    }
+    while(len != 0) {
+      crc = _mm_crc32_u8(crc, *p);
+      ++p;
+      --len;
+    }
+    return ~crc;
+  }
+
+#else
+
+  bool crc32cHardwareSupported() {
+    return false;
+  }
+
+  uint32_t crc32cUpdateHardware(uint32_t crc, char const* data, size_t len) {
+    return crc32cUpdateSoftware(crc, data, len);
+  }
+
+#endif
+
+  uint32_t crc32cUpdate(uint32_t crc, char const* data, size_t len) {
+    static bool const hardware = crc32cHardwareSupported();
+    return hardware ? crc32cUpdateHardware(crc, data, len) : crc32cUpdateSoftware(crc, data, len);
+  }
+}
@@ -0,0 +1,454 @@
+#include "IOPool/Common/interface/FileContents.h"
+#include "IOPool/Common/interface/TreeEntryCount.h"
+
+#include "DataFormats/Provenance/interface/BranchType.h"
+#include "DataFormats/Provenance/interface/EventAuxiliary.h"
+#include "DataFormats/Provenance/interface/FileFormatVersion.h"
+#include "DataFormats/Provenance/interface/FileID.h"
+#include "DataFormats/Provenance/interface/FileIndex.h"
+#include "DataFormats/Provenance/interface/IndexIntoFile.h"
+
+#include "TBranch.h"
+#include "TFile.h"
+#include "TObjArray.h"
+#include "TTree.h"
+
+#include "boost/shared_ptr.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace edm {
+
+  namespace {
+    Long64_t const kEventListCacheSize = 20 * 1024 * 1024;
+    // Fewer than one wanted entry in this many and the cache is not used.
+    Long64_t const kSparseEntryRatio = 16;
+
+    // Reads the first entry of branch 'name' of 'metaDataTree' into
+    // 'object'.  Returns false, leaving 'object' alone, if there is no
+    // such branch.
+    template<typename T>
+    bool readMetaData(TTree* metaDataTree, std::string const& name, T& object) {
+      if(metaDataTree->FindBranch(name.c_str()) == 0) return false;
+      T* objectPtr = &object;
+      TBranch* branch = metaDataTree->GetBranch(name.c_str());
+      branch->SetAddress(&objectPtr);
+      branch->GetEntry(0);
+      branch->ResetAddress();
+      return true;
+    }
+
+    FileFormatVersion readFileFormatVersion(TTree* metaDataTree) {
+      FileFormatVersion fileFormatVersion;
+      readMetaData(metaDataTree, poolNames::fileFormatVersionBranchName(), fileFormatVersion);
+      return fileFormatVersion;
+    }
+
+    Long64_t treeEntries(TFile* tfl, std::string const& name, bool fromKeys) {
+      if(fromKeys) {
+        Long64_t const entries = treeEntriesFromKey(tfl, name.c_str());
+        if(entries != kUndecodedTree) return entries;
+      }
+      TTree* tree = dynamic_cast<TTree*>(tfl->Get(name.c_str()));
+      return tree != 0 ? tree->GetEntries() : -1;
+    }
+
+    void addBranchSizes(TBranch* branch, Long64_t& size) {
+      size += branch->GetTotalSize(); // Includes size of branch metadata
+      // Now recurse through any subbranches.
+      Long64_t nB = branch->GetListOfBranches()->GetEntries();
+      for(Long64_t i = 0; i < nB; ++i) {
+        addBranchSizes(static_cast<TBranch*>(branch->GetListOfBranches()->At(i)), size);
+      }
+    }
+
+    // The compressed size of every basket written for 'branch' and its sub-branches.
+    void addBasketSizes(TBranch* branch, std::vector<Long64_t>& sizes, Long64_t& basketEntries) {
+      Int_t nBaskets = branch->GetWriteBasket();
+      Int_t* basketBytes = branch->GetBasketBytes();
+      for(Int_t i = 0; i < nBaskets; ++i) {
+        sizes.push_back(basketBytes[i]);
+      }
+      if(nBaskets > 0) basketEntries += branch->GetEntries();
+      Long64_t nB = branch->GetListOfBranches()->GetEntries();
+      for(Long64_t i = 0; i < nB; ++i) {
+        addBasketSizes(static_cast<TBranch*>(branch->GetListOfBranches()->At(i)), sizes, basketEntries);
+      }
+    }
+
+    // True if 'name' is the "id_" member of EventAuxiliary or one of its
+    // sub-branches, whatever prefix ROOT gave the split branch names.
+    bool isEventIDBranchName(std::string const& name) {
+      std::string::size_type pos = name.find("id_");
+      while(pos != std::string::npos) {
+        if(pos == 0 || name[pos - 1] == '.') return true;
+        pos = name.find("id_", pos + 1);
+      }
+      return false;
+    }
+
+    // For a split EventAuxiliary, switch off every sub-branch other than
+    // the event ID, or switch them all back on, so that GetEntry on the
+    // top level branch only reads and streams the ID.  Returns the number
+    // of sub-branches switched off.
+    unsigned int selectEventIDBranches(TBranch* branch, bool select) {
+      unsigned int nOff = 0;
+      TObjArray* subBranches = branch->GetListOfBranches();
+      for(Int_t i = 0, n = subBranches->GetEntriesFast(); i < n; ++i) {
+        TBranch* sub = static_cast<TBranch*>(subBranches->UncheckedAt(i));
+        if(select && !isEventIDBranchName(sub->GetName())) {
+          sub->SetBit(kDoNotProcess);
+          ++nOff;
+        } else {
+          sub->ResetBit(kDoNotProcess);
+          nOff += selectEventIDBranches(sub, select);
+        }
+      }
+      return nOff;
+    }
+
+    // Fill 'numbers' with the event numbers of the Events tree 'entries',
+    // which must be sorted.  Reading in ascending entry order through a
+    // TTreeCache decompresses each basket once, however out of order the
+    // entries appear in IndexIntoFile.  Only the event ID is read when
+    // EventAuxiliary is split; otherwise a single EventAuxiliary object is
+    // reused and only its event number is kept, in a flat array.
+    void readEventNumbers(TTree* eventsTree, TBranch* eventAuxBranch,
+                          std::vector<IndexIntoFile::EntryNumber_t> const& entries,
+                          std::vector<EventNumber_t>& numbers) {
+      numbers.clear();
+      if(entries.empty()) return;
+      numbers.reserve(entries.size());
+      bool const split = selectEventIDBranches(eventAuxBranch, true) != 0;
+      // The cache prefetches every basket in the entry range, which only
+      // pays off if a fair fraction of the entries in it are wanted.
+      bool const dense = Long64_t(entries.size()) * kSparseEntryRatio >= entries.back() - entries.front() + 1;
+      if(dense) {
+        eventsTree->SetCacheSize(kEventListCacheSize);
+        eventsTree->AddBranchToCache(eventAuxBranch, kTRUE);
+        eventsTree->SetCacheEntryRange(entries.front(), entries.back() + 1);
+      }
+      EventAuxiliary eventAuxiliary;
+      EventAuxiliary* eAPtr = &eventAuxiliary;
+      eventAuxBranch->SetAddress(&eAPtr);
+      for(std::vector<IndexIntoFile::EntryNumber_t>::const_iterator it = entries.begin(), itEnd = entries.end(); it != itEnd; ++it) {
+        eventAuxBranch->GetEntry(*it);
+        numbers.push_back(eventAuxiliary.id().event());
+      }
+      eventAuxBranch->ResetAddress();
+      if(dense) eventsTree->SetCacheSize(0);
+      if(split) selectEventIDBranches(eventAuxBranch, false);
+    }
+
+    // The event number of 'entry', which must be one of the sorted
+    // 'entries' whose numbers readEventNumbers put in 'numbers'.
+    EventNumber_t eventNumberOf(IndexIntoFile::EntryNumber_t entry,
+                                std::vector<IndexIntoFile::EntryNumber_t> const& entries,
+                                std::vector<EventNumber_t> const& numbers) {
+      return numbers[std::lower_bound(entries.begin(), entries.end(), entry) - entries.begin()];
+    }
+
+    // Sorts 'entries' and drops duplicates, ready for readEventNumbers.
+    void sortEntries(std::vector<IndexIntoFile::EntryNumber_t>& entries) {
+      std::sort(entries.begin(), entries.end());
+      entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    }
+
+    // Answers IndexIntoFile's event number queries from numbers read in
+    // one sequential pass, rather than one EventAuxiliary read per query.
+    // 'entries' is sorted and 'numbers' holds the event number of each;
+    // both must outlive the IndexIntoFile the finder is given to.  It has
+    // no answer for any other entry, so it must only be given to an index
+    // whose events are all among 'entries' (see fillTransientEventNumbers).
+    class PrefetchedEventFinder : public IndexIntoFile::EventFinder {
+    public:
+      PrefetchedEventFinder(std::vector<IndexIntoFile::EntryNumber_t> const& entries,
+                            std::vector<EventNumber_t> const& numbers) :
+        entries_(entries), numbers_(numbers) {}
+      virtual ~PrefetchedEventFinder() {}
+      virtual EventNumber_t getEventNumberOfEntry(IndexIntoFile::EntryNumber_t entry) const {
+        std::vector<IndexIntoFile::EntryNumber_t>::const_iterator it = std::lower_bound(entries_.begin(), entries_.end(), entry);
+        if(it == entries_.end() || *it != entry) return 0;
+        return numbers_[it - entries_.begin()];
+      }
+    private:
+      std::vector<IndexIntoFile::EntryNumber_t> const& entries_;
+      std::vector<EventNumber_t> const& numbers_;
+    };
+
+    // Give 'indexIntoFile' what it needs to fill its transient event
+    // numbers, and so to iterate in numerical order.  Returns false if
+    // the index refers to events whose numbers were not read.
+    bool fillTransientEventNumbers(IndexIntoFile const& indexIntoFile, TTree* eventsTree,
+                                   std::vector<IndexIntoFile::EntryNumber_t> const& entries,
+                                   std::vector<EventNumber_t> const& numbers) {
+      if(entries.size() != numbers.size()) return false;
+      Long64_t const nEvents = eventsTree->GetEntries();
+      for(IndexIntoFile::IndexIntoFileItr it = indexIntoFile.begin(IndexIntoFile::firstAppearanceOrder),
+                                          itEnd = indexIntoFile.end(IndexIntoFile::firstAppearanceOrder);
+                                          it != itEnd; ++it) {
+        if(it.getEntryType() != IndexIntoFile::kEvent) continue;
+        if(it.entry() < 0 || it.entry() >= nEvents ||
+           !std::binary_search(entries.begin(), entries.end(), it.entry())) {
+          return false;
+        }
+      }
+      indexIntoFile.setNumberOfEvents(nEvents);
+      indexIntoFile.setEventFinder(boost::shared_ptr<IndexIntoFile::EventFinder>(new PrefetchedEventFinder(entries, numbers)));
+      return true;
+    }
+
+    EventTableRow::Type rowType(FileIndex::EntryType type) {
+      return type == FileIndex::kRun ? EventTableRow::kRun :
+             (type == FileIndex::kLumi ? EventTableRow::kLumi : EventTableRow::kEvent);
+    }
+
+    EventTableRow::Type rowType(IndexIntoFile::EntryType type) {
+      return type == IndexIntoFile::kRun ? EventTableRow::kRun :
+             (type == IndexIntoFile::kLumi ? EventTableRow::kLumi : EventTableRow::kEvent);
+    }
+
+    bool readFileIndexTable(TTree* metaDataTree, EventTable& table) {
+      FileIndex fileIndex;
+      if(!readMetaData(metaDataTree, poolNames::fileIndexBranchName(), fileIndex)) {
+        table.problem = EventTable::kNoFileIndex;
+        return false;
+      }
+      table.rows.reserve(fileIndex.size());
+      for(std::vector<FileIndex::Element>::const_iterator it = fileIndex.begin(), itEnd = fileIndex.end(); it != itEnd; ++it) {
+        EventTableRow row;
+        row.type = rowType(it->getEntryType());
+        row.run = it->run_;
+        row.lumi = it->lumi_;
+        row.event = it->event_;
+        row.entry = it->entry_;
+        table.rows.push_back(row);
+      }
+      table.fastCopyPossible = fileIndex.allEventsInEntryOrder();
+      fileIndex.sortBy_Run_Lumi_EventEntry();
+      table.noEventSortKnown = true;
+      table.fastCopyPossibleNoEventSort = fileIndex.allEventsInEntryOrder();
+      return true;
+    }
+
+    bool readIndexIntoFileTable(TFile* tfl, TTree* metaDataTree, EventTable& table) {
+      IndexIntoFile indexIntoFile;
+      if(!readMetaData(metaDataTree, poolNames::indexIntoFileBranchName(), indexIntoFile)) {
+        table.problem = EventTable::kNoIndexIntoFile;
+        return false;
+      }
+      //need to read event # from the EventAuxiliary branch
+      TTree* eventsTree = dynamic_cast<TTree*>(tfl->Get(poolNames::eventTreeName().c_str()));
+      TBranch* eventAuxBranch = eventsTree != 0 ? eventsTree->GetBranch("EventAuxiliary") : 0;
+      if(eventAuxBranch == 0) {
+        table.problem = EventTable::kNoEventAuxiliary;
+        return false;
+      }
+
+      // Collect the rows first, so that the event numbers can be read in
+      // entry order rather than in the order the rows appear.
+      std::vector<IndexIntoFile::EntryNumber_t> eventEntries;
+      for(IndexIntoFile::IndexIntoFileItr it = indexIntoFile.begin(IndexIntoFile::firstAppearanceOrder),
+                                          itEnd = indexIntoFile.end(IndexIntoFile::firstAppearanceOrder);
+                                          it != itEnd; ++it) {
+        EventTableRow row;
+        row.type = rowType(it.getEntryType());
+        row.run = it.run();
+        row.lumi = it.lumi();
+        row.event = 0;
+        row.entry = it.entry();
+        table.rows.push_back(row);
+        if(row.type == EventTableRow::kEvent) eventEntries.push_back(row.entry);
+      }
+      sortEntries(eventEntries);
+      std::vector<EventNumber_t> eventNumbers;
+      readEventNumbers(eventsTree, eventAuxBranch, eventEntries, eventNumbers);
+      for(std::vector<EventTableRow>::iterator it = table.rows.begin(), itEnd = table.rows.end(); it != itEnd; ++it) {
+        if(it->type == EventTableRow::kEvent) it->event = eventNumberOf(it->entry, eventEntries, eventNumbers);
+      }
+
+      table.fastCopyPossible = indexIntoFile.iterationWillBeInEntryOrder(IndexIntoFile::firstAppearanceOrder);
+      // Iterating in numerical order needs the event numbers, which are not
+      // persistent.  Serve them from the numbers already read above.
+      table.noEventSortKnown = fillTransientEventNumbers(indexIntoFile, eventsTree, eventEntries, eventNumbers);
+      if(table.noEventSortKnown) {
+        table.fastCopyPossibleNoEventSort = indexIntoFile.iterationWillBeInEntryOrder(IndexIntoFile::numericalOrder);
+      }
+      return true;
+    }
+  }
+
+  std::string readUuid(TTree* metaDataTree) {
+    FileID fid;
+    FileID* fidPtr = &fid;
+    metaDataTree->SetBranchAddress(poolNames::fileIdentifierBranchName().c_str(), &fidPtr);
+    metaDataTree->GetEntry(0);
+    metaDataTree->ResetBranchAddresses();
+    return fid.fid();
+  }
+
+  FileSummary readFileSummary(TFile* tfl, bool withUuid, bool fromKeys) {
+    FileSummary summary;
+    summary.bytes = tfl->GetSize();
+    summary.recovered = tfl->TestBit(TFile::kRecovered);
+    if(withUuid) {
+      TTree* metaDataTree = dynamic_cast<TTree*>(tfl->Get(poolNames::metaDataTreeName().c_str()));
+      if(metaDataTree != 0) summary.uuid = readUuid(metaDataTree);
+    }
+    summary.runs = treeEntries(tfl, poolNames::runTreeName(), fromKeys);
+    summary.lumis = treeEntries(tfl, poolNames::luminosityBlockTreeName(), fromKeys);
+    summary.events = treeEntries(tfl, poolNames::eventTreeName(), fromKeys);
+    return summary;
+  }
+
+  std::vector<BranchSizeInfo> readBranchSizes(TTree* tree) {
+    std::vector<BranchSizeInfo> result;
+    Long64_t nB = tree->GetListOfBranches()->GetEntries();
+    result.reserve(nB);
+    std::vector<Long64_t> sizes;
+    for(Long64_t i = 0; i < nB; ++i) {
+      TBranch* branch = static_cast<TBranch*>(tree->GetListOfBranches()->At(i));
+      BranchSizeInfo info;
+      info.name = branch->GetName();
+      addBranchSizes(branch, info.totalSize);
+      info.zipBytes = branch->GetZipBytes("*");
+      info.totBytes = branch->GetTotBytes("*");
+      sizes.clear();
+      addBasketSizes(branch, sizes, info.basketEntries);
+      info.baskets = sizes.size();
+      if(!sizes.empty()) {
+        std::vector<Long64_t>::iterator median = sizes.begin() + sizes.size() / 2;
+        std::nth_element(sizes.begin(), median, sizes.end());
+        info.medianBasket = *median;
+        info.minBasket = *std::min_element(sizes.begin(), sizes.end());
+        info.maxBasket = *std::max_element(sizes.begin(), sizes.end());
+      }
+      result.push_back(std::move(info));
+    }
+    return result;
+  }
+
+  bool readEventTable(TFile* tfl, EventTable& table) {
+    table = EventTable();
+    TTree* metaDataTree = dynamic_cast<TTree*>(tfl->Get(poolNames::metaDataTreeName().c_str()));
+    if(metaDataTree == 0) {
+      table.problem = EventTable::kNoMetaData;
+      return false;
+    }
+    FileFormatVersion const fileFormatVersion = readFileFormatVersion(metaDataTree);
+    table.fileFormatVersion = fileFormatVersion.value();
+    table.versionSupportsFastCopy = fileFormatVersion.fastCopyPossible();
+    if(fileFormatVersion.hasIndexIntoFile()) {
+      table.source = EventTable::kIndexIntoFile;
+      return readIndexIntoFileTable(tfl, metaDataTree, table);
+    }
+    table.source = EventTable::kFileIndex;
+    return readFileIndexTable(metaDataTree, table);
+  }
+
+  bool readEventsInLumis(TFile* tfl, std::vector<LumiEventCount>& counts) {
+    EventTable::Problem problem;
+    return readEventsInLumis(tfl, counts, problem);
+  }
+
+  bool readEventsInLumis(TFile* tfl, std::vector<LumiEventCount>& counts, EventTable::Problem& problem) {
+    counts.clear();
+    problem = EventTable::kNoProblem;
+    TTree* metaDataTree = dynamic_cast<TTree*>(tfl->Get(poolNames::metaDataTreeName().c_str()));
+    if(metaDataTree == 0) {
+      problem = EventTable::kNoMetaData;
+      return false;
+    }
+
+    if(readFileFormatVersion(metaDataTree).hasIndexIntoFile()) {
+      IndexIntoFile indexIntoFile;
+      if(!readMetaData(metaDataTree, poolNames::indexIntoFileBranchName(), indexIntoFile)) {
+        problem = EventTable::kNoIndexIntoFile;
+        return false;
+      }
+      for(IndexIntoFile::IndexIntoFileItr it = indexIntoFile.begin(IndexIntoFile::firstAppearanceOrder),
+          itEnd = indexIntoFile.end(IndexIntoFile::firstAppearanceOrder);
+          it != itEnd; ++it) {
+        if(it.getEntryType() == IndexIntoFile::kLumi) {
+          if(counts.empty() || counts.back().run != it.run() || counts.back().lumi != it.lumi()) {
+            counts.push_back(LumiEventCount(it.run(), it.lumi()));
+          }
+        } else if(it.getEntryType() == IndexIntoFile::kEvent && !counts.empty()) {
+          ++counts.back().events;
+        }
+      }
+    } else {
+      FileIndex fileIndex;
+      if(!readMetaData(metaDataTree, poolNames::fileIndexBranchName(), fileIndex)) {
+        problem = EventTable::kNoFileIndex;
+        return false;
+      }
+      for(std::vector<FileIndex::Element>::const_iterator it = fileIndex.begin(), itEnd = fileIndex.end(); it != itEnd; ++it) {
+        if(it->getEntryType() == FileIndex::kLumi) {
+          if(counts.empty() || counts.back().run != it->run_ || counts.back().lumi != it->lumi_) {
+            counts.push_back(LumiEventCount(it->run_, it->lumi_));
+          }
+        } else if(it->getEntryType() == FileIndex::kEvent && !counts.empty()) {
+          ++counts.back().events;
+        }
+      }
+    }
+    return true;
+  }
+
+  bool readEventEntries(TFile* tfl, std::vector<EventEntry>& events) {
+    return readEventEntries(tfl, events, [](RunNumber_t, LuminosityBlockNumber_t) { return true; });
+  }
+
+  bool readEventEntries(TFile* tfl, std::vector<EventEntry>& events, LumiSelector const& wantLumi) {
+    events.clear();
+    TTree* metaDataTree = dynamic_cast<TTree*>(tfl->Get(poolNames::metaDataTreeName().c_str()));
+    if(metaDataTree == 0) return false;
+
+    if(!readFileFormatVersion(metaDataTree).hasIndexIntoFile()) {
+      FileIndex fileIndex;
+      if(!readMetaData(metaDataTree, poolNames::fileIndexBranchName(), fileIndex)) return false;
+      for(std::vector<FileIndex::Element>::const_iterator it = fileIndex.begin(), itEnd = fileIndex.end(); it != itEnd; ++it) {
+        if(it->getEntryType() == FileIndex::kEvent && wantLumi(it->run_, it->lumi_)) {
+          EventEntry event;
+          event.run = it->run_;
+          event.lumi = it->lumi_;
+          event.event = it->event_;
+          event.entry = it->entry_;
+          events.push_back(event);
+        }
+      }
+      return true;
+    }
+
+    IndexIntoFile indexIntoFile;
+    if(!readMetaData(metaDataTree, poolNames::indexIntoFileBranchName(), indexIntoFile)) return false;
+    TTree* eventsTree = dynamic_cast<TTree*>(tfl->Get(poolNames::eventTreeName().c_str()));
+    if(eventsTree == 0) return false;
+    TBranch* eventAuxBranch = eventsTree->GetBranch("EventAuxiliary");
+    if(eventAuxBranch == 0) return false;
+
+    std::vector<IndexIntoFile::EntryNumber_t> eventEntries;
+    for(IndexIntoFile::IndexIntoFileItr it = indexIntoFile.begin(IndexIntoFile::firstAppearanceOrder),
+        itEnd = indexIntoFile.end(IndexIntoFile::firstAppearanceOrder);
+        it != itEnd; ++it) {
+      if(it.getEntryType() == IndexIntoFile::kEvent && wantLumi(it.run(), it.lumi())) {
+        EventEntry event;
+        event.run = it.run();
+        event.lumi = it.lumi();
+        event.event = 0;
+        event.entry = it.entry();
+        events.push_back(event);
+        eventEntries.push_back(event.entry);
+      }
+    }
+    sortEntries(eventEntries);
+    std::vector<EventNumber_t> eventNumbers;
+    readEventNumbers(eventsTree, eventAuxBranch, eventEntries, eventNumbers);
+    for(std::vector<EventEntry>::iterator it = events.begin(), itEnd = events.end(); it != itEnd; ++it) {
+      it->event = eventNumberOf(it->entry, eventEntries, eventNumbers);
+    }
+    return true;
+  }
+}
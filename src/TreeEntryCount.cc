@@ -0,0 +1,100 @@
+#include "IOPool/Common/interface/TreeEntryCount.h"
+
+#include "RZip.h"
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TKey.h"
+
+#include <cstring>
+#include <vector>
+
+namespace edm {
+
+  namespace {
+    // Set in the byte count which precedes each versioned object or base
+    // class in a ROOT buffer.
+    unsigned int const kByteCountMask = 0x40000000;
+    // Size of the header of each compressed block of a record.
+    unsigned int const kZipHeaderSize = 9;
+
+    unsigned long long bigEndian(unsigned char const* p, unsigned int n) {
+      unsigned long long value = 0;
+      for(unsigned int i = 0; i < n; ++i) {
+        value = (value << 8) | p[i];
+      }
+      return value;
+    }
+
+    unsigned int littleEndian24(unsigned char const* p) {
+      return p[0] | (p[1] << 8) | (p[2] << 16);
+    }
+
+    // Reads the byte count and version at 'pos'.  On success sets 'end' to
+    // the offset just past the object and 'pos' to its first member.
+    bool readObjectHeader(std::vector<unsigned char> const& buffer, size_t& pos, size_t& end, unsigned int& version) {
+      if(pos + 6 > buffer.size()) return false;
+      unsigned long long const count = bigEndian(&buffer[pos], 4);
+      if((count & kByteCountMask) == 0) return false;
+      end = pos + 4 + (count & ~static_cast<unsigned long long>(kByteCountMask));
+      version = bigEndian(&buffer[pos + 4], 2);
+      pos += 6;
+      return true;
+    }
+
+    bool readRecordStart(TFile* file, TKey* key, std::vector<unsigned char>& buffer) {
+      Long64_t const seek = key->GetSeekKey() + key->GetKeylen();
+      Int_t const stored = key->GetNbytes() - key->GetKeylen();
+      if(stored <= 0) return false;
+      if(key->GetObjlen() <= stored) {
+        // Not compressed.
+        buffer.resize(stored);
+        return !file->ReadBuffer(reinterpret_cast<char*>(&buffer[0]), seek, stored);
+      }
+      // Only the first compressed block is needed: read its header to find
+      // how long it is, then the block itself.
+      unsigned char header[kZipHeaderSize];
+      if(stored < static_cast<Int_t>(kZipHeaderSize) ||
+         file->ReadBuffer(reinterpret_cast<char*>(header), seek, kZipHeaderSize)) {
+        return false;
+      }
+      Int_t zipped = kZipHeaderSize + littleEndian24(header + 3);
+      Int_t unzipped = littleEndian24(header + 6);
+      if(zipped > stored || unzipped <= 0) return false;
+      std::vector<unsigned char> block(zipped);
+      if(file->ReadBuffer(reinterpret_cast<char*>(&block[0]), seek, zipped)) return false;
+      buffer.resize(unzipped);
+      Int_t produced = 0;
+      R__unzip(&zipped, &block[0], &unzipped, reinterpret_cast<char*>(&buffer[0]), &produced);
+      if(produced <= 0) return false;
+      buffer.resize(produced);
+      return true;
+    }
+  }
+
+  Long64_t treeEntriesFromKey(TDirectory* dir, char const* name) {
+    TKey* key = dir->GetKey(name);
+    if(key == 0) return kNoSuchTree;
+    if(std::strcmp(key->GetClassName(), "TTree") != 0) {
+      // Possibly a class derived from TTree, whose layout we do not know.
+      return kUndecodedTree;
+    }
+    TFile* file = dir->GetFile();
+    std::vector<unsigned char> buffer;
+    if(file == 0 || !readRecordStart(file, key, buffer)) return kUndecodedTree;
+
+    // TTree, written member-wise since version 5: the TNamed, TAttLine,
+    // TAttFill and TAttMarker bases, each with its own byte count, then
+    // fEntries.
+    size_t pos = 0;
+    size_t end = 0;
+    unsigned int version = 0;
+    if(!readObjectHeader(buffer, pos, end, version) || version <= 4) return kUndecodedTree;
+    for(unsigned int base = 0; base < 4; ++base) {
+      if(!readObjectHeader(buffer, pos, end, version)) return kUndecodedTree;
+      pos = end;
+    }
+    if(pos + 8 > buffer.size()) return kUndecodedTree;
+    Long64_t const entries = bigEndian(&buffer[pos], 8);
+    return entries >= 0 ? entries : kUndecodedTree;
+  }
+}
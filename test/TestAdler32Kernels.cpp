@@ -0,0 +1,123 @@
+//----------------------------------------------------------------------
+// Checks that the vectorized Adler-32 kernels and adler32Combine give
+// exactly the same result as cms::Adler32, and prints the throughput of
+// each kernel.
+//
+
+#include "IOPool/Common/interface/Adler32Kernels.h"
+#include "FWCore/Utilities/interface/Adler32Calculator.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+  typedef void (*Update)(char const*, size_t, uint32_t&, uint32_t&);
+
+  uint32_t checksum(Update update, char const* data, size_t len, size_t chunk) {
+    uint32_t a = 1, b = 0;
+    for(size_t offset = 0; offset < len; offset += chunk) {
+      size_t n = (len - offset < chunk) ? len - offset : chunk;
+      update(data + offset, n, a, b);
+    }
+    return (b << 16) | a;
+  }
+
+  uint32_t reference(char const* data, size_t len) {
+    uint32_t a = 1, b = 0;
+    cms::Adler32(data, len, a, b);
+    return (b << 16) | a;
+  }
+
+  bool check(char const* name, Update update, std::vector<char> const& data) {
+    bool ok = true;
+    // Lengths around the block size and the modulo reduction interval,
+    // split into chunks of assorted sizes and offsets.
+    size_t const lengths[] = {0, 1, 31, 32, 33, 63, 64, 5551, 5552, 5553, 5600, 65536, 1000003, data.size()};
+    size_t const chunks[] = {1, 7, 32, 100, 5552, 1 << 20, data.size()};
+    size_t const offsets[] = {0, 1, 13};
+    for(auto len : lengths) {
+      for(auto offset : offsets) {
+        if(offset + len > data.size()) continue;
+        uint32_t expected = reference(&data[offset], len);
+        for(auto chunk : chunks) {
+          uint32_t result = checksum(update, &data[offset], len, chunk);
+          if(result != expected) {
+            std::cout << name << ": mismatch for length " << len << " offset " << offset << " chunk " << chunk
+                      << ": " << std::hex << result << " != " << expected << std::dec << std::endl;
+            ok = false;
+          }
+        }
+      }
+    }
+    return ok;
+  }
+
+  // Split the data at assorted points and check that combining the
+  // checksums of the two pieces gives the checksum of the whole.
+  bool checkCombine(std::vector<char> const& data) {
+    bool ok = true;
+    size_t const len = 3 * 1024 * 1024 + 17;
+    uint32_t expected = reference(&data[0], len);
+    size_t const splits[] = {0, 1, 65520, 65521, 65522, 1000000, len - 1, len};
+    for(auto split : splits) {
+      uint32_t first = reference(&data[0], split);
+      uint32_t second = reference(&data[split], len - split);
+      uint32_t result = edm::adler32Combine(first, second, len - split);
+      if(result != expected) {
+        std::cout << "combine: mismatch for split " << split
+                  << ": " << std::hex << result << " != " << expected << std::dec << std::endl;
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  void benchmark(char const* name, Update update, std::vector<char> const& data) {
+    int const nRepeats = 5;
+    uint32_t sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < nRepeats; ++i) {
+      sum ^= checksum(update, &data[0], data.size(), 10 * 1024 * 1024);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double gbPerSecond = nRepeats * static_cast<double>(data.size()) / elapsed.count() / 1.0e9;
+    std::cout << std::setw(8) << name << std::setw(10) << std::fixed << std::setprecision(2) << gbPerSecond
+              << " GB/s  (" << std::hex << sum << std::dec << ")" << std::endl;
+  }
+}
+
+int main() {
+  std::vector<char> data(64 * 1024 * 1024);
+  std::srand(12345);
+  for(auto& c : data) {
+    c = static_cast<char>(std::rand());
+  }
+  // A run of 0xff bytes exercises the largest possible sums.
+  for(size_t i = 0; i < 1024 * 1024; ++i) {
+    data[i] = static_cast<char>(0xff);
+  }
+
+  bool ok = check("scalar", &edm::adler32UpdateScalar, data);
+  if(edm::adler32SSSE3Supported()) {
+    ok = check("ssse3", &edm::adler32UpdateSSSE3, data) && ok;
+  }
+  if(edm::adler32AVX2Supported()) {
+    ok = check("avx2", &edm::adler32UpdateAVX2, data) && ok;
+  }
+  ok = check("default", &edm::adler32Update, data) && ok;
+  ok = checkCombine(data) && ok;
+
+  std::cout << "Selected kernel: " << edm::adler32KernelName() << std::endl;
+  benchmark("scalar", &edm::adler32UpdateScalar, data);
+  if(edm::adler32SSSE3Supported()) {
+    benchmark("ssse3", &edm::adler32UpdateSSSE3, data);
+  }
+  if(edm::adler32AVX2Supported()) {
+    benchmark("avx2", &edm::adler32UpdateAVX2, data);
+  }
+
+  return ok ? 0 : 1;
+}
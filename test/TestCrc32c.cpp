@@ -0,0 +1,68 @@
+//----------------------------------------------------------------------
+// Checks the CRC-32C implementations against known values and against
+// each other.
+//
+
+#include "IOPool/Common/interface/Crc32c.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+  typedef uint32_t (*Update)(uint32_t, char const*, size_t);
+
+  bool check(char const* name, Update update) {
+    bool ok = true;
+    // Check values from RFC 3720, appendix B.4, and the usual "123456789" one.
+    char const* digits = "123456789";
+    std::vector<char> zeros(32, 0);
+    std::vector<char> ones(32, static_cast<char>(0xff));
+    std::vector<char> ascending(32);
+    for(int i = 0; i < 32; ++i) ascending[i] = static_cast<char>(i);
+    struct { char const* data; size_t len; uint32_t expected; } const cases[] = {
+      {digits, std::strlen(digits), 0xe3069283},
+      {&zeros[0], zeros.size(), 0x8a9136aa},
+      {&ones[0], ones.size(), 0x62a8ab43},
+      {&ascending[0], ascending.size(), 0x46dd794e},
+      {digits, 0, 0}
+    };
+    for(auto const& c : cases) {
+      uint32_t result = update(0, c.data, c.len);
+      if(result != c.expected) {
+        std::cout << name << ": crc32c of " << c.len << " bytes is " << std::hex << result
+                  << ", expected " << c.expected << std::dec << std::endl;
+        ok = false;
+      }
+    }
+
+    // Incremental updates must agree with one update over everything.
+    std::vector<char> data(1000003);
+    std::srand(4321);
+    for(auto& c : data) c = static_cast<char>(std::rand());
+    uint32_t whole = edm::crc32cUpdateSoftware(0, &data[0], data.size());
+    size_t const chunks[] = {1, 3, 8, 4096, 65537};
+    for(auto chunk : chunks) {
+      uint32_t crc = 0;
+      for(size_t offset = 0; offset < data.size(); offset += chunk) {
+        crc = update(crc, &data[offset], std::min(chunk, data.size() - offset));
+      }
+      if(crc != whole) {
+        std::cout << name << ": chunked crc32c with chunk " << chunk << " differs" << std::endl;
+        ok = false;
+      }
+    }
+    return ok;
+  }
+}
+
+int main() {
+  bool ok = check("software", &edm::crc32cUpdateSoftware);
+  if(edm::crc32cHardwareSupported()) {
+    ok = check("hardware", &edm::crc32cUpdateHardware) && ok;
+  }
+  ok = check("default", &edm::crc32cUpdate) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+//----------------------------------------------------------------------
+// Checks that treeEntriesFromKey agrees with TTree::GetEntries, and
+// compares the time taken by the two to count the entries of a freshly
+// opened wide file.
+//
+// Usage: TestTreeEntryCount [branches [repetitions]]
+//
+
+#include "IOPool/Common/interface/TreeEntryCount.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+  typedef std::chrono::steady_clock Clock;
+
+  // Events has 'nBranches' branches; Runs has one.
+  void writeFile(std::string const& name, unsigned int nBranches, Long64_t nEvents) {
+    TFile file(name.c_str(), "RECREATE");
+    std::vector<Double_t> values(nBranches, 0.);
+    TTree* events = new TTree("Events", "");
+    for(unsigned int i = 0; i < nBranches; ++i) {
+      std::ostringstream branchName;
+      branchName << "branch" << i;
+      events->Branch(branchName.str().c_str(), &values[i], (branchName.str() + "/D").c_str());
+    }
+    for(Long64_t e = 0; e < nEvents; ++e) {
+      for(unsigned int i = 0; i < nBranches; ++i) values[i] = e + i;
+      events->Fill();
+    }
+    TTree* runs = new TTree("Runs", "");
+    Int_t run = 0;
+    runs->Branch("run", &run, "run/I");
+    for(run = 1; run <= 3; ++run) runs->Fill();
+    file.Write();
+    file.Close();
+  }
+
+  double seconds(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  unsigned int const nBranches = argc > 1 ? std::atoi(argv[1]) : 3000;
+  unsigned int const repetitions = argc > 2 ? std::atoi(argv[2]) : 5;
+  Long64_t const nEvents = 300;
+
+  std::ostringstream name;
+  name << "TestTreeEntryCount_" << getpid() << ".root";
+  writeFile(name.str(), nBranches, nEvents);
+
+  bool ok = true;
+  Clock::duration getTime = Clock::duration::zero();
+  Clock::duration keyTime = Clock::duration::zero();
+  for(unsigned int r = 0; r < repetitions && ok; ++r) {
+    {
+      TFile file(name.str().c_str());
+      Clock::time_point start = Clock::now();
+      TTree* events = static_cast<TTree*>(file.Get("Events"));
+      TTree* runs = static_cast<TTree*>(file.Get("Runs"));
+      Long64_t const nE = events ? events->GetEntries() : -1;
+      Long64_t const nR = runs ? runs->GetEntries() : -1;
+      getTime += Clock::now() - start;
+      if(nE != nEvents || nR != 3) {
+        std::cerr << "TTree::GetEntries gave " << nE << " and " << nR << "\n";
+        ok = false;
+      }
+    }
+    {
+      TFile file(name.str().c_str());
+      Clock::time_point start = Clock::now();
+      Long64_t const nE = edm::treeEntriesFromKey(&file, "Events");
+      Long64_t const nR = edm::treeEntriesFromKey(&file, "Runs");
+      keyTime += Clock::now() - start;
+      if(nE != nEvents || nR != 3) {
+        std::cerr << "treeEntriesFromKey gave " << nE << " and " << nR << "\n";
+        ok = false;
+      }
+      if(edm::treeEntriesFromKey(&file, "LuminosityBlocks") != edm::kNoSuchTree) {
+        std::cerr << "treeEntriesFromKey found a tree which does not exist\n";
+        ok = false;
+      }
+    }
+  }
+  std::remove(name.str().c_str());
+
+  if(ok) {
+    std::cout << nBranches << " branches, " << repetitions << " opens:\n"
+              << std::fixed << std::setprecision(4)
+              << "  TTree::GetEntries   " << seconds(getTime) / repetitions << " s per file\n"
+              << "  treeEntriesFromKey  " << seconds(keyTime) / repetitions << " s per file ("
+              << std::setprecision(1) << seconds(getTime) / std::max(seconds(keyTime), 1e-9) << "x faster)\n";
+  }
+  return ok ? 0 : 1;
+}